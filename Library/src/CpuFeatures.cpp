@@ -0,0 +1,136 @@
+#include "CpuFeatures.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#if defined(_M_X64)
+#include <intrin.h>
+#elif defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+namespace dae
+{
+	namespace
+	{
+		constexpr std::array<std::string_view, 4> simdLevelNames{ "scalar", "sse4", "avx2", "avx512" };
+
+#if defined(_M_X64) || defined(__x86_64__)
+		struct CpuidRegisters
+		{
+			uint32_t eax{};
+			uint32_t ebx{};
+			uint32_t ecx{};
+			uint32_t edx{};
+		};
+
+		CpuidRegisters Cpuid(uint32_t leaf, uint32_t subLeaf)
+		{
+#if defined(_M_X64)
+			int registers[4]{};
+			__cpuidex(registers, static_cast<int>(leaf), static_cast<int>(subLeaf));
+			return { static_cast<uint32_t>(registers[0]), static_cast<uint32_t>(registers[1]), static_cast<uint32_t>(registers[2]), static_cast<uint32_t>(registers[3]) };
+#else
+			CpuidRegisters registers{};
+			__cpuid_count(leaf, subLeaf, registers.eax, registers.ebx, registers.ecx, registers.edx);
+			return registers;
+#endif
+		}
+
+		//the register state the os saves on a context switch
+		uint64_t GetEnabledRegisterState()
+		{
+#if defined(_M_X64)
+			return _xgetbv(0);
+#else
+			uint32_t low{};
+			uint32_t high{};
+			__asm__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+			return (static_cast<uint64_t>(high) << 32) | low;
+#endif
+		}
+
+		bool HasBit(uint32_t value, int bit)
+		{
+			return (value >> bit) & 1;
+		}
+#endif
+
+		SimdLevel DetectSimdLevel()
+		{
+#if defined(_M_X64) || defined(__x86_64__)
+			const uint32_t maxLeaf{ Cpuid(0, 0).eax };
+			const CpuidRegisters features{ Cpuid(1, 0) };
+
+			if (!HasBit(features.ecx, 19) || !HasBit(features.ecx, 20)) return SimdLevel::scalar;
+
+			//the cpu supporting avx is not enough, the os has to save the ymm (and zmm) registers too
+			constexpr uint64_t ymmState{ 0x6 };			//xmm + upper ymm
+			constexpr uint64_t zmmState{ 0xE0 | ymmState };	//+ opmask + upper zmm + zmm16-31
+			const uint64_t registerState{ HasBit(features.ecx, 27) ? GetEnabledRegisterState() : 0 };
+
+			const bool hasAvx{ HasBit(features.ecx, 28) && (registerState & ymmState) == ymmState };
+			const bool hasFma{ HasBit(features.ecx, 12) };
+			if (!hasAvx || !hasFma || maxLeaf < 7) return SimdLevel::sse4;
+
+			const CpuidRegisters extendedFeatures{ Cpuid(7, 0) };
+			if (!HasBit(extendedFeatures.ebx, 5)) return SimdLevel::sse4;
+
+			if (!HasBit(extendedFeatures.ebx, 16) || (registerState & zmmState) != zmmState) return SimdLevel::avx2;
+			return SimdLevel::avx512;
+#else
+			return SimdLevel::scalar;
+#endif
+		}
+
+		//the highest level this build has kernels for
+		constexpr SimdLevel compiledSimdLevel
+		{
+#if defined(DAE_AVX512_KERNELS)
+			SimdLevel::avx512
+#elif defined(DAE_AVX2_KERNELS)
+			SimdLevel::avx2
+#elif defined(DAE_SSE4_KERNELS)
+			SimdLevel::sse4
+#else
+			SimdLevel::scalar
+#endif
+		};
+
+		SimdLevel& GetActiveSimdLevel()
+		{
+			static SimdLevel simdLevel{ GetSupportedSimdLevel() };
+			return simdLevel;
+		}
+	}
+
+	SimdLevel GetSupportedSimdLevel()
+	{
+		static const SimdLevel supportedSimdLevel{ std::min(DetectSimdLevel(), compiledSimdLevel) };
+		return supportedSimdLevel;
+	}
+
+	SimdLevel GetSimdLevel()
+	{
+		return GetActiveSimdLevel();
+	}
+
+	void SetSimdLevel(SimdLevel level)
+	{
+		GetActiveSimdLevel() = std::min(level, GetSupportedSimdLevel());
+	}
+
+	bool SetSimdLevel(std::string_view levelName)
+	{
+		const auto it{ std::find(simdLevelNames.begin(), simdLevelNames.end(), levelName) };
+		if (it == simdLevelNames.end()) return false;
+
+		SetSimdLevel(static_cast<SimdLevel>(it - simdLevelNames.begin()));
+		return true;
+	}
+
+	std::string_view GetSimdLevelName(SimdLevel level)
+	{
+		return simdLevelNames[static_cast<int>(level)];
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <string_view>
+
+//on x64 the kernels of every level are compiled in, which of them run is decided at runtime, see GetSimdLevel
+//msvc emits any instruction set in any function, gcc and clang only avx in functions marked DAE_TARGET_AVX2 / DAE_TARGET_AVX512
+//(lambdas included), so the rest of the binary stays baseline x64 without arch flags
+//the sse4 kernels only use sse2 intrinsics, which every x64 compiler emits, so they need no marker
+#if defined(_M_X64)
+#define DAE_SSE4_KERNELS
+#define DAE_AVX2_KERNELS
+#define DAE_AVX512_KERNELS
+#define DAE_TARGET_AVX2
+#define DAE_TARGET_AVX512
+#elif defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define DAE_SSE4_KERNELS
+#define DAE_AVX2_KERNELS
+#define DAE_AVX512_KERNELS
+#define DAE_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define DAE_TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+#endif
+
+namespace dae
+{
+	//instruction set levels the hot kernels have implementations for, every level includes the ones before it
+	enum class SimdLevel
+	{
+		scalar,
+		sse4,	//SSE4.1 + SSE4.2
+		avx2,	//AVX2 + FMA
+		avx512	//AVX-512F
+	};
+
+	//what the cpu (and os) supports, limited to the kernels compiled into this build, detected on the first call
+	SimdLevel GetSupportedSimdLevel();
+
+	//the level the kernels run at, starts at the supported level
+	//each kernel picks the highest implementation it has at or below it
+	SimdLevel GetSimdLevel();
+	//forces a lower level (to benchmark the fallbacks), clamped to the supported level
+	//call it at startup, before anything has picked its kernels
+	void SetSimdLevel(SimdLevel level);
+	//same, by name ("scalar", "sse4", "avx2" or "avx512"), false when the name is unknown
+	bool SetSimdLevel(std::string_view levelName);
+
+	std::string_view GetSimdLevelName(SimdLevel level);
+}
@@ -7,21 +7,39 @@ namespace dae
 	struct Vertex
 	{
 		Vector3 position{};
-		ColorRGB color{colors::White};
 		Vector2 uv{}; //W2
 		Vector3 normal{}; //W4
 		Vector3 tangent{}; //W4
-		Vector3 viewDirection{}; //W4
 	};
 
-	struct Vertex_Out
+	//the vertices of a mesh with one array per attribute
+	//positions are all the pipeline reads up to culling, uv/normal/tangent are only read for the varyings a pixel shader declares
+	struct VertexStreams
 	{
-		Vector4 position{};
-		ColorRGB color{ colors::White };
-		Vector2 uv{};
-		Vector3 normal{};
-		Vector3 tangent{};
-		Vector3 viewDirection{};
+		std::vector<Vector3> positions{};
+		std::vector<Vector2> uvs{};
+		std::vector<Vector3> normals{};
+		std::vector<Vector3> tangents{};
+
+		VertexStreams() = default;
+		//splits interleaved vertices (as ParseOBJ makes them) into the streams
+		explicit VertexStreams(const std::vector<Vertex>& vertices)
+		{
+			positions.reserve(vertices.size());
+			uvs.reserve(vertices.size());
+			normals.reserve(vertices.size());
+			tangents.reserve(vertices.size());
+
+			for (const Vertex& vertex : vertices)
+			{
+				positions.push_back(vertex.position);
+				uvs.push_back(vertex.uv);
+				normals.push_back(vertex.normal);
+				tangents.push_back(vertex.tangent);
+			}
+		}
+
+		size_t GetNrVertices() const { return positions.size(); }
 	};
 
 	enum class PrimitiveTopology
@@ -32,11 +50,10 @@ namespace dae
 
 	struct Mesh
 	{
-		std::vector<Vertex> vertices{};
+		VertexStreams vertices{};
 		std::vector<uint32_t> indices{};
 		PrimitiveTopology primitiveTopology{ PrimitiveTopology::TriangleStrip };
 
-		std::vector<Vertex_Out> vertices_out{};
 		Matrix worldMatrix{};
 	};
 }
@@ -0,0 +1,72 @@
+#include "FrameArena.h"
+
+#include <new>
+
+namespace dae
+{
+	namespace
+	{
+		constexpr size_t AlignUp(size_t value, size_t alignment)
+		{
+			return (value + alignment - 1) & ~(alignment - 1);
+		}
+	}
+
+	FrameArena::FrameArena(size_t capacity) :
+		m_Capacity{ AlignUp(capacity, blockAlignment) }
+	{
+		if (m_Capacity > 0) m_pBlock = static_cast<std::byte*>(::operator new(m_Capacity, std::align_val_t{ blockAlignment }));
+	}
+
+	FrameArena::~FrameArena()
+	{
+		FreeOverflowBlocks();
+		if (m_pBlock) ::operator delete(m_pBlock, std::align_val_t{ blockAlignment });
+	}
+
+	void* FrameArena::Allocate(size_t size, size_t alignment)
+	{
+		const size_t offset{ AlignUp(m_Offset, alignment) };
+		if (offset + size <= m_Capacity)
+		{
+			m_Offset = offset + size;
+			return m_pBlock + offset;
+		}
+
+		//doesn't fit: a block of its own, the header in front of it keeps the list of blocks to free
+		constexpr size_t headerSize{ AlignUp(sizeof(OverflowBlock), blockAlignment) };
+		std::byte* pBlock{ static_cast<std::byte*>(::operator new(headerSize + size, std::align_val_t{ blockAlignment })) };
+		m_pOverflowBlocks = new (pBlock) OverflowBlock{ m_pOverflowBlocks };
+		m_OverflowSize += size + alignment;
+
+		return pBlock + headerSize;
+	}
+
+	void FrameArena::Reset()
+	{
+		if (m_pOverflowBlocks)
+		{
+			//the frame didn't fit: grow to its peak (plus some slack) so the next one does
+			const size_t capacity{ AlignUp(GetSize() + GetSize() / 4, blockAlignment) };
+
+			FreeOverflowBlocks();
+
+			if (m_pBlock) ::operator delete(m_pBlock, std::align_val_t{ blockAlignment });
+			m_pBlock = static_cast<std::byte*>(::operator new(capacity, std::align_val_t{ blockAlignment }));
+			m_Capacity = capacity;
+		}
+
+		m_Offset = 0;
+		m_OverflowSize = 0;
+	}
+
+	void FrameArena::FreeOverflowBlocks()
+	{
+		while (m_pOverflowBlocks)
+		{
+			OverflowBlock* pBlock{ m_pOverflowBlocks };
+			m_pOverflowBlocks = pBlock->pNext;
+			::operator delete(pBlock, std::align_val_t{ blockAlignment });
+		}
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dae
+{
+	//linear allocator for everything that lives for one frame: allocating is a pointer bump, Reset frees it all at once
+	//allocations that don't fit get their own heap block, Reset then grows the arena to the peak of that frame
+	//so once the frames stop growing the arena never touches the heap again
+	class FrameArena final
+	{
+	public:
+		explicit FrameArena(size_t capacity = 0);
+		~FrameArena();
+
+		FrameArena(const FrameArena&) = delete;
+		FrameArena(FrameArena&&) noexcept = delete;
+		FrameArena& operator=(const FrameArena&) = delete;
+		FrameArena& operator=(FrameArena&&) noexcept = delete;
+
+		//uninitialized memory, valid until the next Reset, alignment is a power of 2 up to 64
+		void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+		template<typename T>
+		T* Allocate(size_t count) { return static_cast<T*>(Allocate(sizeof(T) * count, alignof(T))); }
+
+		//everything allocated since the last Reset is gone after this
+		void Reset();
+
+		size_t GetCapacity() const { return m_Capacity; }
+		//bytes handed out since the last Reset, including padding and overflow blocks
+		size_t GetSize() const { return m_Offset + m_OverflowSize; }
+
+	private:
+		void FreeOverflowBlocks();
+
+		//the block start is aligned to a cache line, so is everything that asks for it
+		static constexpr size_t blockAlignment{ 64 };
+
+		//heap block for an allocation that didn't fit, freed in Reset
+		struct OverflowBlock
+		{
+			OverflowBlock* pNext{};
+		};
+
+		std::byte* m_pBlock{};
+		size_t m_Capacity{};
+		size_t m_Offset{};
+
+		OverflowBlock* m_pOverflowBlocks{};
+		size_t m_OverflowSize{};
+	};
+
+	//std allocator on top of a frame arena, deallocate does nothing: the memory goes back in FrameArena::Reset
+	template<typename T>
+	class ArenaAllocator
+	{
+	public:
+		using value_type = T;
+
+		ArenaAllocator(FrameArena& arena) noexcept : m_pArena{ &arena } {}
+		template<typename U>
+		ArenaAllocator(const ArenaAllocator<U>& other) noexcept : m_pArena{ other.GetArena() } {}
+
+		T* allocate(size_t count) { return m_pArena->Allocate<T>(count); }
+		void deallocate(T*, size_t) noexcept {}
+
+		FrameArena* GetArena() const { return m_pArena; }
+
+		template<typename U>
+		bool operator==(const ArenaAllocator<U>& other) const { return m_pArena == other.GetArena(); }
+
+	private:
+		FrameArena* m_pArena;
+	};
+
+	//vector whose buffer lives in a frame arena, it must not outlive the next Reset
+	template<typename T>
+	using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+}
@@ -2,10 +2,150 @@
 
 #include <cassert>
 
+#include "CpuFeatures.h"
 #include "MathHelpers.h"
 #include <cmath>
+#if defined(DAE_SSE4_KERNELS)
+#include <immintrin.h>
+#endif
 
 namespace dae {
+#if defined(DAE_SSE4_KERNELS)
+	namespace
+	{
+		//every SIMD path multiplies and adds in the same order as the scalar code (no fma), so the results are identical
+
+		__m128 LoadRow(const Vector4& row)
+		{
+			return _mm_load_ps(&row.x);
+		}
+
+		//row0 * x + row1 * y + row2 * z (+ row3)
+		template<bool addRow3>
+		__m128 TransformRows(const __m128 rows[4], float x, float y, float z)
+		{
+			__m128 result{ _mm_add_ps(_mm_mul_ps(rows[0], _mm_set1_ps(x)), _mm_mul_ps(rows[1], _mm_set1_ps(y))) };
+			result = _mm_add_ps(result, _mm_mul_ps(rows[2], _mm_set1_ps(z)));
+			if constexpr (addRow3) result = _mm_add_ps(result, rows[3]);
+			return result;
+		}
+
+		//x, y and z divided by w, w is kept
+		__m128 PerspectiveDivide(__m128 position)
+		{
+			const __m128 divided{ _mm_div_ps(position, _mm_shuffle_ps(position, position, _MM_SHUFFLE(3, 3, 3, 3))) };
+			//(divided.x, divided.y, divided.z, position.w)
+			return _mm_shuffle_ps(divided, _mm_unpackhi_ps(divided, position), _MM_SHUFFLE(3, 0, 1, 0));
+		}
+
+		__m128 Cross(__m128 a, __m128 b)
+		{
+			const __m128 aYZX{ _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1)) };
+			const __m128 bZXY{ _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2)) };
+			const __m128 aZXY{ _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2)) };
+			const __m128 bYZX{ _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1)) };
+			return _mm_sub_ps(_mm_mul_ps(aYZX, bZXY), _mm_mul_ps(aZXY, bYZX));
+		}
+
+		//dot of x, y and z in every lane
+		__m128 Dot3(__m128 a, __m128 b)
+		{
+			const __m128 product{ _mm_mul_ps(a, b) };
+			const __m128 dot{ _mm_add_ss(_mm_add_ss(product, _mm_shuffle_ps(product, product, _MM_SHUFFLE(1, 1, 1, 1))), _mm_shuffle_ps(product, product, _MM_SHUFFLE(2, 2, 2, 2))) };
+			return _mm_shuffle_ps(dot, dot, _MM_SHUFFLE(0, 0, 0, 0));
+		}
+
+		//the w lane of a vector, in every lane
+		__m128 SplatW(__m128 v)
+		{
+			return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));
+		}
+
+		//the TransformPoints kernels, one point per iteration
+		template<bool divide>
+		void TransformPointsSse4(const Vector4 matrixRows[4], std::span<const Vector3> points, std::span<Vector4> out)
+		{
+			const __m128 rows[4]{ LoadRow(matrixRows[0]), LoadRow(matrixRows[1]), LoadRow(matrixRows[2]), LoadRow(matrixRows[3]) };
+			for (size_t i{}; i < points.size(); ++i)
+			{
+				__m128 result{ TransformRows<true>(rows, points[i].x, points[i].y, points[i].z) };
+				if constexpr (divide) result = PerspectiveDivide(result);
+				_mm_storeu_ps(&out[i].x, result);
+			}
+		}
+
+#if defined(DAE_AVX2_KERNELS)
+		//2 points per iteration, one per 128 bit lane
+		template<bool divide>
+		DAE_TARGET_AVX2 void TransformPointsAvx2(const Vector4 matrixRows[4], std::span<const Vector3> points, std::span<Vector4> out)
+		{
+			const __m256 rows[4]{ _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&matrixRows[0].x)), _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&matrixRows[1].x)),
+				_mm256_broadcast_ps(reinterpret_cast<const __m128*>(&matrixRows[2].x)), _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&matrixRows[3].x)) };
+
+			size_t i{};
+			for (; i + 2 <= points.size(); i += 2)
+			{
+				const Vector3& point0{ points[i] };
+				const Vector3& point1{ points[i + 1] };
+
+				__m256 result{ _mm256_add_ps(_mm256_mul_ps(rows[0], _mm256_set_m128(_mm_set1_ps(point1.x), _mm_set1_ps(point0.x))),
+					_mm256_mul_ps(rows[1], _mm256_set_m128(_mm_set1_ps(point1.y), _mm_set1_ps(point0.y)))) };
+				result = _mm256_add_ps(result, _mm256_mul_ps(rows[2], _mm256_set_m128(_mm_set1_ps(point1.z), _mm_set1_ps(point0.z))));
+				result = _mm256_add_ps(result, rows[3]);
+
+				if constexpr (divide)
+				{
+					const __m256 divided{ _mm256_div_ps(result, _mm256_permute_ps(result, _MM_SHUFFLE(3, 3, 3, 3))) };
+					result = _mm256_blend_ps(divided, result, 0b10001000);
+				}
+
+				_mm256_storeu_ps(&out[i].x, result);
+			}
+			TransformPointsSse4<divide>(matrixRows, points.subspan(i), out.subspan(i));
+		}
+#endif
+
+#if defined(DAE_AVX512_KERNELS)
+		//the same value in each 128 bit lane of a 512 bit register
+		DAE_TARGET_AVX512 __m512 Broadcast4(float lane0, float lane1, float lane2, float lane3)
+		{
+			__m512 result{ _mm512_castps128_ps512(_mm_set1_ps(lane0)) };
+			result = _mm512_insertf32x4(result, _mm_set1_ps(lane1), 1);
+			result = _mm512_insertf32x4(result, _mm_set1_ps(lane2), 2);
+			return _mm512_insertf32x4(result, _mm_set1_ps(lane3), 3);
+		}
+
+		//4 points per iteration, one per 128 bit lane
+		template<bool divide>
+		DAE_TARGET_AVX512 void TransformPointsAvx512(const Vector4 matrixRows[4], std::span<const Vector3> points, std::span<Vector4> out)
+		{
+			const __m512 rows[4]{ _mm512_broadcast_f32x4(LoadRow(matrixRows[0])), _mm512_broadcast_f32x4(LoadRow(matrixRows[1])),
+				_mm512_broadcast_f32x4(LoadRow(matrixRows[2])), _mm512_broadcast_f32x4(LoadRow(matrixRows[3])) };
+
+			size_t i{};
+			for (; i + 4 <= points.size(); i += 4)
+			{
+				const Vector3* pPoints{ &points[i] };
+
+				__m512 result{ _mm512_add_ps(_mm512_mul_ps(rows[0], Broadcast4(pPoints[0].x, pPoints[1].x, pPoints[2].x, pPoints[3].x)),
+					_mm512_mul_ps(rows[1], Broadcast4(pPoints[0].y, pPoints[1].y, pPoints[2].y, pPoints[3].y))) };
+				result = _mm512_add_ps(result, _mm512_mul_ps(rows[2], Broadcast4(pPoints[0].z, pPoints[1].z, pPoints[2].z, pPoints[3].z)));
+				result = _mm512_add_ps(result, rows[3]);
+
+				if constexpr (divide)
+				{
+					const __m512 divided{ _mm512_div_ps(result, _mm512_permute_ps(result, _MM_SHUFFLE(3, 3, 3, 3))) };
+					result = _mm512_mask_blend_ps(0x8888, divided, result);
+				}
+
+				_mm512_storeu_ps(&out[i].x, result);
+			}
+			TransformPointsAvx2<divide>(matrixRows, points.subspan(i), out.subspan(i));
+		}
+#endif
+	}
+#endif
+
 	Matrix::Matrix(const Vector3& xAxis, const Vector3& yAxis, const Vector3& zAxis, const Vector3& t) :
 		Matrix({ xAxis, 0 }, { yAxis, 0 }, { zAxis, 0 }, { t, 1 })
 	{
@@ -70,6 +210,70 @@ namespace dae {
 		};
 	}
 
+	void Matrix::TransformVectors(std::span<const Vector3> vectors, std::span<Vector3> out) const
+	{
+		assert(vectors.size() == out.size());
+
+		size_t i{};
+#if defined(DAE_SSE4_KERNELS)
+		if (GetSimdLevel() >= SimdLevel::sse4)
+		{
+			const __m128 rows[4]{ LoadRow(data[0]), LoadRow(data[1]), LoadRow(data[2]), LoadRow(data[3]) };
+
+			//x and y in one 8 byte store, z on its own: a 16 byte store would overwrite the next vector before an in-place call reads it
+			for (; i < vectors.size(); ++i)
+			{
+				const __m128 result{ TransformRows<false>(rows, vectors[i].x, vectors[i].y, vectors[i].z) };
+				_mm_store_sd(reinterpret_cast<double*>(&out[i].x), _mm_castps_pd(result));
+				_mm_store_ss(&out[i].z, _mm_movehl_ps(result, result));
+			}
+		}
+#endif
+		for (; i < vectors.size(); ++i)
+		{
+			out[i] = TransformVector(vectors[i]);
+		}
+	}
+
+	void Matrix::TransformPoints(std::span<const Vector3> points, std::span<Vector4> out, bool perspectiveDivide) const
+	{
+		assert(points.size() == out.size());
+
+		//the widest kernel the active simd level allows, they all give the same results
+		[[maybe_unused]] const SimdLevel simdLevel{ GetSimdLevel() };
+		const auto transformPoints{ [&]<bool divide>()
+			{
+#if defined(DAE_AVX512_KERNELS)
+				if (simdLevel >= SimdLevel::avx512) return TransformPointsAvx512<divide>(data, points, out);
+#endif
+#if defined(DAE_AVX2_KERNELS)
+				if (simdLevel >= SimdLevel::avx2) return TransformPointsAvx2<divide>(data, points, out);
+#endif
+#if defined(DAE_SSE4_KERNELS)
+				if (simdLevel >= SimdLevel::sse4) return TransformPointsSse4<divide>(data, points, out);
+#endif
+				for (size_t i{}; i < points.size(); ++i)
+				{
+					out[i] = TransformPoint({ points[i], 1.f });
+					if constexpr (divide)
+					{
+						out[i].x /= out[i].w;
+						out[i].y /= out[i].w;
+						out[i].z /= out[i].w;
+					}
+				}
+			} };
+
+		if (perspectiveDivide) transformPoints.template operator()<true>();
+		else transformPoints.template operator()<false>();
+	}
+
+	SimdLevel Matrix::GetTransformSimdLevel()
+	{
+		//TransformPoints has a kernel for every level, the others stop at sse4
+		return GetSimdLevel();
+	}
+
 	const Matrix& Matrix::Transpose()
 	{
 		Matrix result{};
@@ -92,6 +296,50 @@ namespace dae {
 	const Matrix& Matrix::Inverse()
 	{
 		//Optimized Inverse as explained in FGED1 - used widely in other libraries too.
+#if defined(DAE_SSE4_KERNELS)
+		if (GetSimdLevel() >= SimdLevel::sse4)
+		{
+			//same steps as the scalar version below on whole rows, x, y, z and w are the w lanes of the rows
+			const __m128 a{ LoadRow(data[0]) };
+			const __m128 b{ LoadRow(data[1]) };
+			const __m128 c{ LoadRow(data[2]) };
+			const __m128 d{ LoadRow(data[3]) };
+
+			const __m128 x{ SplatW(a) };
+			const __m128 y{ SplatW(b) };
+			const __m128 z{ SplatW(c) };
+			const __m128 w{ SplatW(d) };
+
+			__m128 s{ Cross(a, b) };
+			__m128 t{ Cross(c, d) };
+			__m128 u{ _mm_sub_ps(_mm_mul_ps(a, y), _mm_mul_ps(b, x)) };
+			__m128 v{ _mm_sub_ps(_mm_mul_ps(c, w), _mm_mul_ps(d, z)) };
+
+			const __m128 det{ _mm_add_ps(Dot3(s, v), Dot3(t, u)) };
+			assert((!AreEqual(_mm_cvtss_f32(det), 0.f)) && "ERROR: determinant is 0, there is no INVERSE!");
+			const __m128 invDet{ _mm_div_ps(_mm_set1_ps(1.f), det) };
+
+			s = _mm_mul_ps(s, invDet); t = _mm_mul_ps(t, invDet); u = _mm_mul_ps(u, invDet); v = _mm_mul_ps(v, invDet);
+
+			__m128 r0{ _mm_add_ps(Cross(b, v), _mm_mul_ps(t, y)) };
+			__m128 r1{ _mm_sub_ps(Cross(v, a), _mm_mul_ps(t, x)) };
+			__m128 r2{ _mm_add_ps(Cross(d, u), _mm_mul_ps(s, w)) };
+			__m128 r3{ _mm_setzero_ps() };
+
+			//r0, r1 and r2 are the columns of the upper 3x3, the zero row ends up as the w column
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_mm_store_ps(&data[0].x, r0);
+			_mm_store_ps(&data[1].x, r1);
+			_mm_store_ps(&data[2].x, r2);
+
+			const __m128 negate{ _mm_set_ps(1.f, -1.f, 1.f, -1.f) };
+			const __m128 translation{ _mm_unpacklo_ps(_mm_unpacklo_ps(Dot3(b, t), Dot3(d, s)), _mm_unpacklo_ps(Dot3(a, t), Dot3(c, s))) };
+			_mm_store_ps(&data[3].x, _mm_mul_ps(translation, negate));
+
+			return *this;
+		}
+#endif
+
 		const Vector3& a = data[0];
 		const Vector3& b = data[1];
 		const Vector3& c = data[2];
@@ -257,6 +505,22 @@ namespace dae {
 	Matrix Matrix::operator*(const Matrix& m) const
 	{
 		Matrix result{};
+#if defined(DAE_SSE4_KERNELS)
+		if (GetSimdLevel() >= SimdLevel::sse4)
+		{
+			//every result row is a combination of the rows of m, no transpose needed
+			const __m128 rows[4]{ LoadRow(m.data[0]), LoadRow(m.data[1]), LoadRow(m.data[2]), LoadRow(m.data[3]) };
+			for (int r{ 0 }; r < 4; ++r)
+			{
+				__m128 row{ TransformRows<false>(rows, data[r].x, data[r].y, data[r].z) };
+				row = _mm_add_ps(row, _mm_mul_ps(rows[3], _mm_set1_ps(data[r].w)));
+				_mm_store_ps(&result.data[r].x, row);
+			}
+
+			return result;
+		}
+#endif
+
 		Matrix m_transposed = Transpose(m);
 
 		for (int r{ 0 }; r < 4; ++r)
@@ -272,16 +536,11 @@ namespace dae {
 
 	const Matrix& Matrix::operator*=(const Matrix& m)
 	{
-		Matrix copy{ *this };
-		Matrix m_transposed = Transpose(m);
-
-		for (int r{ 0 }; r < 4; ++r)
-		{
-			for (int c{ 0 }; c < 4; ++c)
-			{
-				data[r][c] = Vector4::Dot(copy[r], m_transposed[c]);
-			}
-		}
+		const Matrix result{ *this * m };
+		data[0] = result[0];
+		data[1] = result[1];
+		data[2] = result[2];
+		data[3] = result[3];
 
 		return *this;
 	}
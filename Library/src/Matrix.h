@@ -1,4 +1,6 @@
 #pragma once
+#include <span>
+#include "CpuFeatures.h"
 #include "Vector3.h"
 #include "Vector4.h"
 
@@ -28,6 +30,15 @@ namespace dae {
 		Vector4 TransformPoint(const Vector4& p) const;
 		Vector4 TransformPoint(float x, float y, float z, float w) const;
 
+		//batched versions: out[i] is the transform of in[i], both spans have the same size and don't overlap
+		//SSE up to AVX-512 depending on the cpu (see CpuFeatures.h), the results match the single versions bit for bit
+		//out can also be vectors itself, to transform in place
+		void TransformVectors(std::span<const Vector3> vectors, std::span<Vector3> out) const;
+		//points with w = 1, perspectiveDivide divides x, y and z by w (w is kept)
+		void TransformPoints(std::span<const Vector3> points, std::span<Vector4> out, bool perspectiveDivide = false) const;
+		//the instruction set the batched transforms run with
+		static SimdLevel GetTransformSimdLevel();
+
 		const Matrix& Transpose();
 		const Matrix& Inverse();
 
@@ -59,8 +70,8 @@ namespace dae {
 
 	private:
 
-		//Row-Major Matrix
-		Vector4 data[4]
+		//Row-Major Matrix, aligned so a row loads straight into a SIMD register
+		alignas(16) Vector4 data[4]
 		{
 			{1,0,0,0}, //xAxis
 			{0,1,0,0}, //yAxis
@@ -0,0 +1,125 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+
+#include "Vector4.h"
+
+namespace dae
+{
+	//screen positions are snapped to a fixed point grid with 8 bits of sub-pixel precision
+	constexpr int subPixelBits{ 8 };
+	constexpr int64_t subPixelOne{ int64_t{ 1 } << subPixelBits };
+	constexpr int64_t subPixelHalf{ subPixelOne / 2 };
+
+	//fixed point edge equation: value = stepX * px + stepY * py + origin, inside when >= 0
+	//the top-left fill rule is already folded into origin
+	struct EdgeFunction
+	{
+		int64_t stepX{};
+		int64_t stepY{};
+		int64_t origin{};
+
+		int64_t Evaluate(int px, int py) const { return stepX * px + stepY * py + origin; }
+	};
+
+	//edge a->b in sub-pixel coordinates, evaluated at pixel centers: cross(b - a, p - a)
+	//stepping one pixel in x or y is a single add
+	inline EdgeFunction SetupEdgeFunction(int64_t ax, int64_t ay, int64_t bx, int64_t by)
+	{
+		EdgeFunction edge{};
+		edge.stepX = (ay - by) * subPixelOne;
+		edge.stepY = (bx - ax) * subPixelOne;
+		//value at the center of pixel (0,0)
+		edge.origin = (bx - ax) * (subPixelHalf - ay) - (by - ay) * (subPixelHalf - ax);
+
+		//top-left rule: pixels exactly on the edge only belong to top and left edges
+		//so a pixel on an edge shared by two triangles is drawn exactly once
+		const bool isTopLeft{ (ay > by) || (ay == by && bx > ax) };
+		if (!isTopLeft) edge.origin -= 1;
+
+		return edge;
+	}
+
+	//triangles within this many viewports (in ndc units) of the screen are only scissored by the bounding box,
+	//the fixed point setup stays exact in that range
+	constexpr float guardBand{ 16.f };
+
+	//clip space planes, a position p is inside a plane when Dot(plane, p) >= 0
+	inline const Vector4 clipSpacePlanes[]
+	{
+		//screen edges: only used to reject triangles and count guard band accepts, never clipped against
+		{ 1.f, 0.f, 0.f, 1.f },
+		{ -1.f, 0.f, 0.f, 1.f },
+		{ 0.f, 1.f, 0.f, 1.f },
+		{ 0.f, -1.f, 0.f, 1.f },
+		//near (z >= 0) and far (z <= w)
+		{ 0.f, 0.f, 1.f, 0.f },
+		{ 0.f, 0.f, -1.f, 1.f },
+		//guard band
+		{ 1.f, 0.f, 0.f, guardBand },
+		{ -1.f, 0.f, 0.f, guardBand },
+		{ 0.f, 1.f, 0.f, guardBand },
+		{ 0.f, -1.f, 0.f, guardBand }
+	};
+	constexpr int nrClipSpacePlanes{ 10 };
+	constexpr uint32_t screenEdgePlanes{ 0b0000001111 };
+	constexpr uint32_t clippingPlanes{ 0b1111110000 };
+	//every plane adds at most one vertex to a convex polygon
+	constexpr int maxClippedVertices{ 3 + nrClipSpacePlanes };
+
+	//one bit per plane the position is outside of
+	inline uint32_t ComputeOutcode(const Vector4& position)
+	{
+		uint32_t outcode{};
+		for (int planeIdx{}; planeIdx < nrClipSpacePlanes; ++planeIdx)
+		{
+			if (Vector4::Dot(clipSpacePlanes[planeIdx], position) < 0.f) outcode |= 1u << planeIdx;
+		}
+		return outcode;
+	}
+
+	//sutherland-hodgman in place, only against the planes in planeMask, returns the new number of vertices (< 3 when nothing is left)
+	//both arrays hold maxClippedVertices, the attributes of a new vertex are lerp(attributes0, attributes1, t)
+	//the polygon stays convex and keeps its winding
+	template<typename Attributes, typename LerpFunction>
+	int ClipPolygon(Vector4* polygon, Attributes* attributes, int nrVertices, uint32_t planeMask, const LerpFunction& lerp)
+	{
+		Vector4 clippedPolygon[maxClippedVertices]{};
+		Attributes clippedAttributes[maxClippedVertices]{};
+
+		for (int planeIdx{}; planeIdx < nrClipSpacePlanes && nrVertices >= 3; ++planeIdx)
+		{
+			if (!(planeMask & (1u << planeIdx))) continue;
+
+			const Vector4& plane{ clipSpacePlanes[planeIdx] };
+			int nrClippedVertices{};
+
+			for (int vertexIdx{}; vertexIdx < nrVertices; ++vertexIdx)
+			{
+				const int nextIdx{ (vertexIdx + 1) % nrVertices };
+				const float currentDistance{ Vector4::Dot(plane, polygon[vertexIdx]) };
+				const float nextDistance{ Vector4::Dot(plane, polygon[nextIdx]) };
+
+				if (currentDistance >= 0.f)
+				{
+					clippedPolygon[nrClippedVertices] = polygon[vertexIdx];
+					clippedAttributes[nrClippedVertices++] = attributes[vertexIdx];
+				}
+
+				//edge strictly crosses the plane -> add the intersection, a vertex on the plane is already kept as is
+				if ((currentDistance > 0.f && nextDistance < 0.f) || (currentDistance < 0.f && nextDistance > 0.f))
+				{
+					const float t{ currentDistance / (currentDistance - nextDistance) };
+					clippedPolygon[nrClippedVertices] = polygon[vertexIdx] + (polygon[nextIdx] - polygon[vertexIdx]) * t;
+					clippedAttributes[nrClippedVertices++] = lerp(attributes[vertexIdx], attributes[nextIdx], t);
+				}
+			}
+
+			std::copy_n(clippedPolygon, nrClippedVertices, polygon);
+			std::copy_n(clippedAttributes, nrClippedVertices, attributes);
+			nrVertices = nrClippedVertices;
+		}
+
+		return nrVertices;
+	}
+}
@@ -1,63 +1,876 @@
 #include "Texture.h"
+#include "CpuFeatures.h"
+#include "ThreadPool.h"
 #include "Vector2.h"
 #include <SDL_image.h>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
-namespace dae
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#if defined(DAE_SSE4_KERNELS)
+#include <immintrin.h>
+#endif
+
+namespace
 {
-	Texture::Texture(SDL_Surface* pSurface) :
-		m_pSurface{ pSurface },
-		m_pSurfacePixels{ (uint32_t*)pSurface->pixels }
+	//std::lround without the library call: halfway cases go away from zero
+	//value minus its truncation is exact, so this rounds exactly like std::lround
+	int RoundToInt(float value)
 	{
+		const int truncated{ static_cast<int>(value) };
+		const float fraction{ value - static_cast<float>(truncated) };
+		return truncated + (fraction >= .5f) - (fraction <= -.5f);
 	}
 
-	Texture::~Texture()
+	//levels below this many texels are not worth splitting over the thread pool
+	constexpr int minParallelTexels{ 256 * 256 };
+
+	//nearest texel along one axis, uvs outside [0, 1] clamp to the edge texels
+	int GetNearestTexel(float uvCoordinate, int size)
+	{
+		return std::clamp(RoundToInt(static_cast<float>(size) * uvCoordinate + 0.5f), 0, size - 1);
+	}
+
+	//z-order of a texel inside its 4x4 tile: the 2 bits of x and y interleaved
+	uint32_t InterleaveTileBits(uint32_t x, uint32_t y)
+	{
+		return (x & 1) | ((y & 1) << 1) | ((x & 2) << 1) | ((y & 2) << 2);
+	}
+
+	//rounded average of 4 RGBA8 texels, per channel
+	uint32_t AverageTexels(uint32_t texel0, uint32_t texel1, uint32_t texel2, uint32_t texel3)
+	{
+		uint32_t result{};
+		for (int shift{}; shift < 32; shift += 8)
+		{
+			const uint32_t sum{ ((texel0 >> shift) & 0xFF) + ((texel1 >> shift) & 0xFF) + ((texel2 >> shift) & 0xFF) + ((texel3 >> shift) & 0xFF) };
+			result |= ((sum + 2) >> 2) << shift;
+		}
+		return result;
+	}
+
+#if defined(DAE_SSE4_KERNELS)
+	//AverageTexels of the 2x2 blocks of 8 texels in 2 rows -> 4 texels
+	__m128i AverageTexels(const uint32_t* pRow0, const uint32_t* pRow1)
+	{
+		const __m128i zero{ _mm_setzero_si128() };
+		const __m128i rounding{ _mm_set1_epi16(2) };
+
+		//4 texels per row -> 2, with 16 bits per channel
+		const auto average = [&](__m128i row0, __m128i row1)
+			{
+				const __m128i columns01{ _mm_add_epi16(_mm_unpacklo_epi8(row0, zero), _mm_unpacklo_epi8(row1, zero)) };
+				const __m128i columns23{ _mm_add_epi16(_mm_unpackhi_epi8(row0, zero), _mm_unpackhi_epi8(row1, zero)) };
+				const __m128i sum{ _mm_add_epi16(_mm_unpacklo_epi64(columns01, columns23), _mm_unpackhi_epi64(columns01, columns23)) };
+				return _mm_srli_epi16(_mm_add_epi16(sum, rounding), 2);
+			};
+
+		const __m128i low{ average(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow0)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow1))) };
+		const __m128i high{ average(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow0 + 4)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow1 + 4))) };
+		return _mm_packus_epi16(low, high);
+	}
+#endif
+
+	//one row of the next mip level, the last texel of an odd width averages the last column with itself
+	void DownsampleRow(const uint32_t* pRow0, const uint32_t* pRow1, int width, uint32_t* pDestination, int destinationWidth, int nrTexelWords)
+	{
+		int x{};
+#if defined(DAE_SSE4_KERNELS)
+		//rgba8 only, the words of a material texel are averaged one by one below
+		if (nrTexelWords == 1 && dae::GetSimdLevel() >= dae::SimdLevel::sse4)
+		{
+			for (; x + 4 <= destinationWidth && x * 2 + 8 <= width; x += 4)
+			{
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pDestination + x), AverageTexels(pRow0 + x * 2, pRow1 + x * 2));
+			}
+		}
+#endif
+		for (; x < destinationWidth; ++x)
+		{
+			const int x0{ x * 2 * nrTexelWords };
+			const int x1{ std::min(x * 2 + 1, width - 1) * nrTexelWords };
+			for (int wordIdx{}; wordIdx < nrTexelWords; ++wordIdx)
+			{
+				pDestination[x * nrTexelWords + wordIdx] = AverageTexels(pRow0[x0 + wordIdx], pRow0[x1 + wordIdx], pRow1[x0 + wordIdx], pRow1[x1 + wordIdx]);
+			}
+		}
+	}
+
+	//[0, 255] -> [0, 1]
+	float ToUnorm(uint32_t value)
+	{
+		return static_cast<float>(value & 0xFF) / 255.f;
+	}
+
+	//[0, 255] -> [-1, 1]
+	float ToSnorm(uint32_t value)
+	{
+		return 2.f * ToUnorm(value) - 1.f;
+	}
+
+	//the 2 words of a texel in the uncompressed material format
+	dae::Texture::MaterialSample UnpackMaterial(uint32_t word0, uint32_t word1)
+	{
+		dae::Texture::MaterialSample material{};
+		material.diffuse = { ToUnorm(word0), ToUnorm(word0 >> 8), ToUnorm(word0 >> 16) };
+		material.specular = ToUnorm(word0 >> 24);
+		material.normal.x = ToSnorm(word1);
+		material.normal.y = ToSnorm(word1 >> 8);
+		material.normal.z = std::sqrt(std::max(1.f - material.normal.x * material.normal.x - material.normal.y * material.normal.y, 0.f));
+		material.glossiness = ToUnorm(word1 >> 16);
+		return material;
+	}
+
+	//byte offsets of the parts of a compressed material block
+	constexpr int bc1DiffuseOffset{ 0 };
+	constexpr int bc4SpecularOffset{ 8 };
+	constexpr int bc4NormalXOffset{ 16 };
+	constexpr int bc4NormalYOffset{ 24 };
+	constexpr int bc4GlossinessOffset{ 32 };
+	constexpr int blockBytes{ 40 };
+
+	//palettes of BC1 (4 entries, n = 3) and BC4 (8 entries, n = 7): entries 0 and 1 are the endpoints, the others blend them in order
+	//only the modes with endpoint 0 > endpoint 1 exist, the encoder never writes the others
+	uint32_t BlendEndpoints(uint32_t endpoint0, uint32_t endpoint1, uint32_t paletteIdx, uint32_t n)
+	{
+		const uint32_t weight1{ paletteIdx == 1 ? n : (paletteIdx == 0 ? 0 : paletteIdx - 1) };
+		return ((n - weight1) * endpoint0 + weight1 * endpoint1 + n / 2) / n;
+	}
+
+	//RGB565 -> RGB8 with red in the lowest byte
+	uint32_t Expand565(uint32_t color)
+	{
+		const uint32_t red{ (color >> 11) & 31 };
+		const uint32_t green{ (color >> 5) & 63 };
+		const uint32_t blue{ color & 31 };
+		return ((red << 3) | (red >> 2)) | (((green << 2) | (green >> 4)) << 8) | (((blue << 3) | (blue >> 2)) << 16);
+	}
+
+	uint32_t Quantize565(uint32_t color)
+	{
+		const uint32_t red{ ((color & 0xFF) * 31 + 127) / 255 };
+		const uint32_t green{ (((color >> 8) & 0xFF) * 63 + 127) / 255 };
+		const uint32_t blue{ (((color >> 16) & 0xFF) * 31 + 127) / 255 };
+		return (red << 11) | (green << 5) | blue;
+	}
+
+	uint32_t DecodeBc1(const std::byte* pBlock, int texelIdx)
+	{
+		uint32_t endpoints{};
+		uint32_t indices{};
+		std::memcpy(&endpoints, pBlock, sizeof(endpoints));
+		std::memcpy(&indices, pBlock + 4, sizeof(indices));
+
+		const uint32_t color0{ Expand565(endpoints & 0xFFFF) };
+		const uint32_t color1{ Expand565(endpoints >> 16) };
+		const uint32_t paletteIdx{ (indices >> (texelIdx * 2)) & 3 };
+
+		uint32_t color{};
+		for (int shift{}; shift < 24; shift += 8)
+		{
+			color |= BlendEndpoints((color0 >> shift) & 0xFF, (color1 >> shift) & 0xFF, paletteIdx, 3) << shift;
+		}
+		return color;
+	}
+
+	uint32_t DecodeBc4(const std::byte* pBlock, int texelIdx)
+	{
+		uint64_t bits{};
+		std::memcpy(&bits, pBlock, sizeof(bits));
+
+		const uint32_t paletteIdx{ static_cast<uint32_t>(bits >> (16 + texelIdx * 3)) & 7 };
+		return BlendEndpoints(static_cast<uint32_t>(bits) & 0xFF, static_cast<uint32_t>(bits >> 8) & 0xFF, paletteIdx, 7);
+	}
+
+	//range fit: the endpoints are the corners of the bounding box, every texel takes the closest palette entry
+	uint64_t EncodeBc1(const uint32_t(&colors)[16])
+	{
+		uint32_t minColor{};
+		uint32_t maxColor{};
+		for (int shift{}; shift < 24; shift += 8)
+		{
+			uint32_t minChannel{ 255 };
+			uint32_t maxChannel{ 0 };
+			for (const uint32_t color : colors)
+			{
+				minChannel = std::min(minChannel, (color >> shift) & 0xFF);
+				maxChannel = std::max(maxChannel, (color >> shift) & 0xFF);
+			}
+			minColor |= minChannel << shift;
+			maxColor |= maxChannel << shift;
+		}
+
+		//quantizing keeps every channel of the max corner >= the min corner, so endpoint 0 >= endpoint 1
+		const uint32_t endpoint0{ Quantize565(maxColor) };
+		const uint32_t endpoint1{ Quantize565(minColor) };
+		uint64_t block{ endpoint0 | (endpoint1 << 16) };
+		if (endpoint0 == endpoint1) return block;
+
+		const uint32_t color0{ Expand565(endpoint0) };
+		const uint32_t color1{ Expand565(endpoint1) };
+		for (int texelIdx{}; texelIdx < 16; ++texelIdx)
+		{
+			uint32_t bestPaletteIdx{};
+			int bestError{ std::numeric_limits<int>::max() };
+			for (uint32_t paletteIdx{}; paletteIdx < 4; ++paletteIdx)
+			{
+				int error{};
+				for (int shift{}; shift < 24; shift += 8)
+				{
+					const int difference{ static_cast<int>(BlendEndpoints((color0 >> shift) & 0xFF, (color1 >> shift) & 0xFF, paletteIdx, 3)) - static_cast<int>((colors[texelIdx] >> shift) & 0xFF) };
+					error += difference * difference;
+				}
+				if (error < bestError)
+				{
+					bestError = error;
+					bestPaletteIdx = paletteIdx;
+				}
+			}
+			block |= static_cast<uint64_t>(bestPaletteIdx) << (32 + texelIdx * 2);
+		}
+		return block;
+	}
+
+	uint64_t EncodeBc4(const uint32_t(&values)[16])
+	{
+		const auto [pMin, pMax] = std::minmax_element(std::begin(values), std::end(values));
+		const uint32_t endpoint0{ *pMax };
+		const uint32_t endpoint1{ *pMin };
+		uint64_t block{ endpoint0 | (endpoint1 << 8) };
+		if (endpoint0 == endpoint1) return block;
+
+		for (int texelIdx{}; texelIdx < 16; ++texelIdx)
+		{
+			uint32_t bestPaletteIdx{};
+			int bestError{ std::numeric_limits<int>::max() };
+			for (uint32_t paletteIdx{}; paletteIdx < 8; ++paletteIdx)
+			{
+				const int error{ std::abs(static_cast<int>(BlendEndpoints(endpoint0, endpoint1, paletteIdx, 7)) - static_cast<int>(values[texelIdx])) };
+				if (error < bestError)
+				{
+					bestError = error;
+					bestPaletteIdx = paletteIdx;
+				}
+			}
+			block |= static_cast<uint64_t>(bestPaletteIdx) << (16 + texelIdx * 3);
+		}
+		return block;
+	}
+
+	//one texel of a compressed material block in the uncompressed material format
+	void DecodeBlockTexel(const std::byte* pBlock, int texelIdx, uint32_t& word0, uint32_t& word1)
+	{
+		word0 = DecodeBc1(pBlock + bc1DiffuseOffset, texelIdx) | (DecodeBc4(pBlock + bc4SpecularOffset, texelIdx) << 24);
+		word1 = DecodeBc4(pBlock + bc4NormalXOffset, texelIdx) | (DecodeBc4(pBlock + bc4NormalYOffset, texelIdx) << 8) | (DecodeBc4(pBlock + bc4GlossinessOffset, texelIdx) << 16) | 0xFF000000;
+	}
+
+	//a whole block in the uncompressed material format
+	struct DecodedBlock
+	{
+		uint64_t key{ ~0ull };	//cache id << 32 | first word of the block
+		uint32_t texels[16][2]{};
+	};
+
+	//direct mapped, a few kB per thread
+	constexpr uint32_t nrDecodedBlocks{ 32 };
+	thread_local DecodedBlock decodedBlocks[nrDecodedBlocks]{};
+
+	std::atomic<uint32_t> nextCacheId{};
+
+#if defined(DAE_AVX2_KERNELS)
+	//std::lround for 8 lanes: halfway cases go away from zero
+	DAE_TARGET_AVX2 __m256i RoundToInt(__m256 value)
+	{
+		const __m256 signMask{ _mm256_set1_ps(-0.f) };
+		const __m256 magnitude{ _mm256_andnot_ps(signMask, value) };
+		const __m256 truncated{ _mm256_round_ps(magnitude, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC) };
+		const __m256 roundUp{ _mm256_cmp_ps(_mm256_sub_ps(magnitude, truncated), _mm256_set1_ps(.5f), _CMP_GE_OQ) };
+		const __m256 rounded{ _mm256_add_ps(truncated, _mm256_and_ps(roundUp, _mm256_set1_ps(1.f))) };
+		return _mm256_cvttps_epi32(_mm256_or_ps(rounded, _mm256_and_ps(value, signMask)));
+	}
+
+	//the nearest texel of 8 lanes and the MipLevel fields it needs for its address
+	struct NearestTexels
+	{
+		__m256i x;
+		__m256i y;
+		__m256i stride;
+		__m256i offset;
+	};
+
+	//Texture::GetMipLevel + the coordinates of GetNearestTexelIdx for 8 lanes, every lane can be on its own mip level
+	//pMipLevels: the fields of Texture::MipLevel as ints
+	DAE_TARGET_AVX2 NearestTexels GetNearestTexels(const int* pMipLevels, int nrMipLevels, float lodBias, const float* pU, const float* pV, const float* pUvLods)
+	{
+		const __m256 u{ _mm256_loadu_ps(pU) };
+		const __m256 v{ _mm256_loadu_ps(pV) };
+
+		//max picks 0 for NaN
+		const __m256 levelValue{ _mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(pUvLods), _mm256_set1_ps(lodBias)), _mm256_set1_ps(.5f)) };
+		const __m256i mipLevel{ _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(levelValue, _mm256_setzero_ps()), _mm256_set1_ps(static_cast<float>(nrMipLevels - 1)))) };
+
+		const __m256i mipLevelIdx{ _mm256_slli_epi32(mipLevel, 2) };
+		const __m256i width{ _mm256_i32gather_epi32(pMipLevels, mipLevelIdx, 4) };
+		const __m256i height{ _mm256_i32gather_epi32(pMipLevels + 1, mipLevelIdx, 4) };
+		const __m256i stride{ _mm256_i32gather_epi32(pMipLevels + 2, mipLevelIdx, 4) };
+		const __m256i offset{ _mm256_i32gather_epi32(pMipLevels + 3, mipLevelIdx, 4) };
+
+		const __m256i one{ _mm256_set1_epi32(1) };
+		const __m256i xCord{ RoundToInt(_mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(width), u), _mm256_set1_ps(.5f))) };
+		const __m256i yCord{ RoundToInt(_mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(height), v), _mm256_set1_ps(.5f))) };
+		const __m256i x{ _mm256_min_epi32(_mm256_max_epi32(xCord, _mm256_setzero_si256()), _mm256_sub_epi32(width, one)) };
+		const __m256i y{ _mm256_min_epi32(_mm256_max_epi32(yCord, _mm256_setzero_si256()), _mm256_sub_epi32(height, one)) };
+		return { x, y, stride, offset };
+	}
+
+	//Texture::GetTexelIdx for 8 lanes, tiled layouts use 4x4 tiles
+	DAE_TARGET_AVX2 __m256i GetTexelIndices(const NearestTexels& texels, bool isTiled, int nrTexelWords)
+	{
+		const auto& [x, y, stride, offset] = texels;
+		const __m256i one{ _mm256_set1_epi32(1) };
+
+		__m256i texelIdx{};
+		if (!isTiled)
+		{
+			texelIdx = _mm256_add_epi32(x, _mm256_mullo_epi32(y, stride));
+		}
+		else
+		{
+			const __m256i tileMask{ _mm256_set1_epi32(3) };
+			const __m256i tileRow{ _mm256_mullo_epi32(_mm256_andnot_si256(tileMask, y), stride) };
+			const __m256i tileColumn{ _mm256_slli_epi32(_mm256_andnot_si256(tileMask, x), 2) };
+			const __m256i two{ _mm256_set1_epi32(2) };
+			const __m256i xBits{ _mm256_or_si256(_mm256_and_si256(x, one), _mm256_slli_epi32(_mm256_and_si256(x, two), 1)) };
+			const __m256i yBits{ _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(y, one), 1), _mm256_slli_epi32(_mm256_and_si256(y, two), 2)) };
+			texelIdx = _mm256_add_epi32(_mm256_add_epi32(tileRow, tileColumn), _mm256_or_si256(xBits, yBits));
+		}
+		return _mm256_add_epi32(_mm256_mullo_epi32(texelIdx, _mm256_set1_epi32(nrTexelWords)), offset);
+	}
+
+	//BlendEndpoints for 8 lanes, the divide is a multiply + shift that is exact for every value the palettes produce
+	DAE_TARGET_AVX2 __m256i BlendEndpoints(__m256i endpoint0, __m256i endpoint1, __m256i paletteIdx, int n, int reciprocal)
+	{
+		const __m256i one{ _mm256_set1_epi32(1) };
+		const __m256i nValue{ _mm256_set1_epi32(n) };
+		const __m256i weight1{ _mm256_blendv_epi8(_mm256_max_epi32(_mm256_sub_epi32(paletteIdx, one), _mm256_setzero_si256()), nValue, _mm256_cmpeq_epi32(paletteIdx, one)) };
+		const __m256i weight0{ _mm256_sub_epi32(nValue, weight1) };
+		const __m256i sum{ _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(weight0, endpoint0), _mm256_mullo_epi32(weight1, endpoint1)), _mm256_set1_epi32(n / 2)) };
+		return _mm256_srli_epi32(_mm256_mullo_epi32(sum, _mm256_set1_epi32(reciprocal)), 16);
+	}
+
+	//Expand565 for one channel of 8 lanes
+	DAE_TARGET_AVX2 __m256i ExpandChannel(__m256i color, int shift, int bits)
+	{
+		const __m256i channel{ _mm256_and_si256(_mm256_srli_epi32(color, shift), _mm256_set1_epi32((1 << bits) - 1)) };
+		return _mm256_or_si256(_mm256_slli_epi32(channel, 8 - bits), _mm256_srli_epi32(channel, 2 * bits - 8));
+	}
+
+	//one texel of 8 compressed material blocks, pBlocks + blockOffset is the first byte of every lane's block
+	//gathers read unaligned 32-bit words at byte offsets, at most 3 bytes past the last index of a block
+	struct CompressedTexels
+	{
+		const int* pBlocks;
+		__m256i blockOffset;
+		__m256i texelIdx;	//in the block
+		__m256i gatherMask;
+
+		DAE_TARGET_AVX2 __m256i Gather(int byteOffset) const
+		{
+			return _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), pBlocks, _mm256_add_epi32(blockOffset, _mm256_set1_epi32(byteOffset)), gatherMask, 1);
+		}
+
+		//DecodeBc4
+		DAE_TARGET_AVX2 __m256i DecodeBc4(int byteOffset) const
+		{
+			const __m256i endpoints{ Gather(byteOffset) };
+			const __m256i mask{ _mm256_set1_epi32(0xFF) };
+
+			//3-bit indices from bit 16 on, the word at the byte that holds the first bit of each lane's index
+			const __m256i bitIdx{ _mm256_add_epi32(_mm256_mullo_epi32(texelIdx, _mm256_set1_epi32(3)), _mm256_set1_epi32(16)) };
+			const __m256i indexWords{ _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), pBlocks,
+				_mm256_add_epi32(_mm256_add_epi32(blockOffset, _mm256_set1_epi32(byteOffset)), _mm256_srli_epi32(bitIdx, 3)), gatherMask, 1) };
+			const __m256i paletteIdx{ _mm256_and_si256(_mm256_srlv_epi32(indexWords, _mm256_and_si256(bitIdx, _mm256_set1_epi32(7))), _mm256_set1_epi32(7)) };
+
+			return BlendEndpoints(_mm256_and_si256(endpoints, mask), _mm256_and_si256(_mm256_srli_epi32(endpoints, 8), mask), paletteIdx, 7, 9363);
+		}
+
+		//DecodeBc1, one channel per lane and call
+		DAE_TARGET_AVX2 __m256i DecodeBc1(int byteOffset, __m256i& green, __m256i& blue) const
+		{
+			const __m256i endpoints{ Gather(byteOffset) };
+			const __m256i indices{ Gather(byteOffset + 4) };
+			const __m256i paletteIdx{ _mm256_and_si256(_mm256_srlv_epi32(indices, _mm256_slli_epi32(texelIdx, 1)), _mm256_set1_epi32(3)) };
+
+			const __m256i color0{ _mm256_and_si256(endpoints, _mm256_set1_epi32(0xFFFF)) };
+			const __m256i color1{ _mm256_srli_epi32(endpoints, 16) };
+
+			green = BlendEndpoints(ExpandChannel(color0, 5, 6), ExpandChannel(color1, 5, 6), paletteIdx, 3, 21846);
+			blue = BlendEndpoints(ExpandChannel(color0, 0, 5), ExpandChannel(color1, 0, 5), paletteIdx, 3, 21846);
+			return BlendEndpoints(ExpandChannel(color0, 11, 5), ExpandChannel(color1, 11, 5), paletteIdx, 3, 21846);
+		}
+	};
+
+	//lanes in laneMask -> all bits set
+	DAE_TARGET_AVX2 __m256i ToLaneMask(uint32_t laneMask)
+	{
+		const __m256i laneBits{ _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128) };
+		return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(static_cast<int>(laneMask)), laneBits), laneBits);
+	}
+
+	//byte channel of 8 texels -> [0, 1]
+	DAE_TARGET_AVX2 __m256 ToUnorm(__m256i texels, int shift)
+	{
+		const __m256i channel{ _mm256_and_si256(_mm256_srli_epi32(texels, shift), _mm256_set1_epi32(0xFF)) };
+		return _mm256_div_ps(_mm256_cvtepi32_ps(channel), _mm256_set1_ps(255.f));
+	}
+#endif
+}
+
+namespace dae
+{
+	Texture::Texture(int width, int height, TexelLayout layout, TexelFormat format)
+		: m_Layout{ layout }
+		, m_Format{ format }
+		, m_NrTexelWords{ format == TexelFormat::material ? 2 : (format == TexelFormat::rgba8 ? 1 : 0) }
+		, m_CacheId{ nextCacheId.fetch_add(1, std::memory_order_relaxed) }
 	{
-		if (m_pSurface)
+		//the levels one after the other in one block, every level starts on a cache line
+		constexpr uint32_t wordsPerLine{ texelAlignment / sizeof(uint32_t) };
+		static_assert(tileSize * tileSize == wordsPerLine);
+		const auto roundToTiles = [](int size) { return (size + tileSize - 1) / tileSize * tileSize; };
+
+		uint32_t nrWords{};
+		for (;;)
 		{
-			SDL_FreeSurface(m_pSurface);
-			m_pSurface = nullptr;
+			uint32_t nrLevelWords{};
+			if (format == TexelFormat::compressedMaterial)
+			{
+				//the edge blocks repeat the last row and column
+				const int stride{ (width + blockSize - 1) / blockSize };
+				m_MipLevels[m_NrMipLevels++] = MipLevel{ width, height, stride, nrWords };
+				nrLevelWords = static_cast<uint32_t>(stride * ((height + blockSize - 1) / blockSize) * blockWords);
+			}
+			else
+			{
+				//tiled levels are padded to whole tiles, the padding is never sampled
+				const int stride{ layout == TexelLayout::tiled ? roundToTiles(width) : width };
+				const int nrRows{ layout == TexelLayout::tiled ? roundToTiles(height) : height };
+				m_MipLevels[m_NrMipLevels++] = MipLevel{ width, height, stride, nrWords };
+				nrLevelWords = static_cast<uint32_t>(stride * nrRows * m_NrTexelWords);
+			}
+			nrWords += (nrLevelWords + wordsPerLine - 1) / wordsPerLine * wordsPerLine;
+
+			if ((width == 1 && height == 1) || m_NrMipLevels == maxMipLevels) break;
+			//rounded up, so the last column or row of an odd level still has a texel below it
+			width = (width + 1) / 2;
+			height = (height + 1) / 2;
 		}
+
+		//the compressed decoders read up to 3 bytes past a block
+		if (format == TexelFormat::compressedMaterial) ++nrWords;
+
+		m_LodBias = .5f * std::log2(static_cast<float>(m_MipLevels[0].width) * static_cast<float>(m_MipLevels[0].height));
+		m_NrWords = nrWords;
+		m_pTexels = static_cast<uint32_t*>(::operator new(sizeof(uint32_t) * nrWords, std::align_val_t{ texelAlignment }));
 	}
 
-	Texture* Texture::LoadFromFile(const std::string& path)
+	Texture::~Texture()
 	{
-		//TODO
-		//Load SDL_Surface using IMG_LOAD
-		//Create & Return a new Texture Object (using SDL_Surface)
-		SDL_Surface* psurface = IMG_Load(path.c_str());
+		::operator delete(m_pTexels, std::align_val_t{ texelAlignment });
+	}
 
-		if (!psurface)
+	Texture* Texture::LoadTexels(const std::string& path)
+	{
+		SDL_Surface* pSurface{ IMG_Load(path.c_str()) };
+		if (!pSurface)
 		{
 			std::cout << "failed to load Texture";
 			return nullptr;
 		}
-		return new Texture(psurface);
-		
+
+		//SDL does the format conversion, whatever the file held (24-bit, paletted, ...)
+		SDL_Surface* pRgbaSurface{ SDL_ConvertSurfaceFormat(pSurface, SDL_PIXELFORMAT_RGBA32, 0) };
+		SDL_FreeSurface(pSurface);
+		if (!pRgbaSurface)
+		{
+			std::cout << "failed to convert Texture";
+			return nullptr;
+		}
+
+		Texture* pTexture{ new Texture(pRgbaSurface->w, pRgbaSurface->h, TexelLayout::rowMajor) };
+		for (int y{}; y < pRgbaSurface->h; ++y)
+		{
+			std::memcpy(pTexture->m_pTexels + y * pRgbaSurface->w, static_cast<const std::byte*>(pRgbaSurface->pixels) + y * pRgbaSurface->pitch, sizeof(uint32_t) * pRgbaSurface->w);
+		}
+		SDL_FreeSurface(pRgbaSurface);
+		return pTexture;
+	}
+
+	Texture* Texture::Finish(Texture* pTexture, ThreadPool* pThreadPool, TexelLayout layout)
+	{
+		pTexture->BuildMipLevels(pThreadPool);
+		if (layout == TexelLayout::rowMajor) return pTexture;
+
+		//the box filter works on rows, the tiles are made from the finished chain
+		Texture* pTiledTexture{ new Texture(pTexture->GetWidth(), pTexture->GetHeight(), layout, pTexture->m_Format) };
+		pTiledTexture->CopyTexels(*pTexture);
+		delete pTexture;
+		return pTiledTexture;
+	}
+
+	Texture* Texture::LoadFromFile(const std::string& path, ThreadPool* pThreadPool, TexelLayout layout)
+	{
+		Texture* pTexture{ LoadTexels(path) };
+		return pTexture ? Finish(pTexture, pThreadPool, layout) : nullptr;
+	}
+
+	Texture* Texture::LoadMaterialFromFiles(const std::string& diffusePath, const std::string& normalPath, const std::string& specularPath, const std::string& glossinessPath,
+		ThreadPool* pThreadPool, TexelLayout layout, MaterialFormat format)
+	{
+		const std::unique_ptr<Texture> pDiffuseMap{ LoadTexels(diffusePath) };
+		const std::unique_ptr<Texture> pNormalMap{ LoadTexels(normalPath) };
+		const std::unique_ptr<Texture> pSpecularMap{ LoadTexels(specularPath) };
+		const std::unique_ptr<Texture> pGlossinessMap{ LoadTexels(glossinessPath) };
+		if (!pDiffuseMap || !pNormalMap || !pSpecularMap || !pGlossinessMap) return nullptr;
+
+		const int width{ pDiffuseMap->GetWidth() };
+		const int height{ pDiffuseMap->GetHeight() };
+		for (const Texture* pMap : { pNormalMap.get(), pSpecularMap.get(), pGlossinessMap.get() })
+		{
+			if (pMap->GetWidth() != width || pMap->GetHeight() != height)
+			{
+				std::cout << "material maps differ in size";
+				return nullptr;
+			}
+		}
+
+		return CreateMaterial(width, height, pDiffuseMap->m_pTexels, pNormalMap->m_pTexels, pSpecularMap->m_pTexels, pGlossinessMap->m_pTexels, pThreadPool, layout, format);
+	}
+
+	Texture* Texture::CreateMaterial(int width, int height, const uint32_t* pDiffuseMap, const uint32_t* pNormalMap, const uint32_t* pSpecularMap, const uint32_t* pGlossinessMap,
+		ThreadPool* pThreadPool, TexelLayout layout, MaterialFormat format)
+	{
+		//word 0: diffuse RGB + specular, word 1: normal XY + glossiness, the last byte is unused
+		Texture* pMaterial{ new Texture(width, height, TexelLayout::rowMajor, TexelFormat::material) };
+		for (int texelIdx{}; texelIdx < width * height; ++texelIdx)
+		{
+			pMaterial->m_pTexels[texelIdx * 2] = (pDiffuseMap[texelIdx] & 0x00FFFFFF) | (pSpecularMap[texelIdx] << 24);
+			pMaterial->m_pTexels[texelIdx * 2 + 1] = (pNormalMap[texelIdx] & 0x0000FFFF) | ((pGlossinessMap[texelIdx] & 0xFF) << 16) | 0xFF000000;
+		}
+
+		if (format == MaterialFormat::uncompressed) return Finish(pMaterial, pThreadPool, layout);
+
+		//the mip chain is filtered uncompressed, then every level is encoded
+		pMaterial->BuildMipLevels(pThreadPool);
+		Texture* pCompressedMaterial{ Compress(*pMaterial, pThreadPool) };
+		delete pMaterial;
+		return pCompressedMaterial;
+	}
+
+	Texture* Texture::Compress(const Texture& material, ThreadPool* pThreadPool)
+	{
+		Texture* pCompressedMaterial{ new Texture(material.GetWidth(), material.GetHeight(), TexelLayout::rowMajor, TexelFormat::compressedMaterial) };
+		std::byte* pBlocks{ reinterpret_cast<std::byte*>(pCompressedMaterial->m_pTexels) };
+
+		for (int levelIdx{}; levelIdx < material.m_NrMipLevels; ++levelIdx)
+		{
+			const MipLevel& source{ material.m_MipLevels[levelIdx] };
+			const MipLevel& destination{ pCompressedMaterial->m_MipLevels[levelIdx] };
+
+			const auto compressBlockRow{ [&](uint32_t blockY)
+				{
+					for (int blockX{}; blockX < destination.stride; ++blockX)
+					{
+						//every part of the block is encoded on its own
+						uint32_t diffuse[16]{};
+						uint32_t specular[16]{};
+						uint32_t normalX[16]{};
+						uint32_t normalY[16]{};
+						uint32_t glossiness[16]{};
+						for (int texelIdx{}; texelIdx < 16; ++texelIdx)
+						{
+							const int x{ std::min(blockX * blockSize + texelIdx % blockSize, source.width - 1) };
+							const int y{ std::min(static_cast<int>(blockY) * blockSize + texelIdx / blockSize, source.height - 1) };
+							const uint32_t* pTexel{ material.m_pTexels + material.GetTexelIdx(source, x, y) };
+							diffuse[texelIdx] = pTexel[0] & 0x00FFFFFF;
+							specular[texelIdx] = pTexel[0] >> 24;
+							normalX[texelIdx] = pTexel[1] & 0xFF;
+							normalY[texelIdx] = (pTexel[1] >> 8) & 0xFF;
+							glossiness[texelIdx] = (pTexel[1] >> 16) & 0xFF;
+						}
+
+						const uint64_t parts[]{ EncodeBc1(diffuse), EncodeBc4(specular), EncodeBc4(normalX), EncodeBc4(normalY), EncodeBc4(glossiness) };
+						static_assert(sizeof(parts) == blockBytes && blockBytes == blockWords * sizeof(uint32_t));
+						const uint32_t blockWordIdx{ destination.offset + (blockY * destination.stride + blockX) * blockWords };
+						std::memcpy(pBlocks + blockWordIdx * sizeof(uint32_t), parts, sizeof(parts));
+					}
+				} };
+
+			const uint32_t nrBlockRows{ static_cast<uint32_t>((source.height + blockSize - 1) / blockSize) };
+			if (pThreadPool && source.width * source.height >= minParallelTexels)
+			{
+				pThreadPool->ParallelFor(nrBlockRows, compressBlockRow);
+			}
+			else
+			{
+				for (uint32_t blockY{}; blockY < nrBlockRows; ++blockY)
+				{
+					compressBlockRow(blockY);
+				}
+			}
+		}
+		return pCompressedMaterial;
+	}
+
+	void Texture::CopyTexels(const Texture& source)
+	{
+		for (int levelIdx{}; levelIdx < m_NrMipLevels; ++levelIdx)
+		{
+			const MipLevel& sourceLevel{ source.m_MipLevels[levelIdx] };
+			const MipLevel& destinationLevel{ m_MipLevels[levelIdx] };
+			for (int y{}; y < destinationLevel.height; ++y)
+			{
+				for (int x{}; x < destinationLevel.width; ++x)
+				{
+					std::copy_n(source.m_pTexels + source.GetTexelIdx(sourceLevel, x, y), m_NrTexelWords, m_pTexels + GetTexelIdx(destinationLevel, x, y));
+				}
+			}
+		}
+	}
+
+	uint32_t Texture::GetTexelIdx(const MipLevel& level, int x, int y) const
+	{
+		if (m_Layout == TexelLayout::rowMajor) return level.offset + (x + y * level.stride) * m_NrTexelWords;
+
+		//start of the tile row + start of the tile + z-order inside the tile
+		constexpr int tileMask{ tileSize - 1 };
+		const uint32_t texelIdx{ (y & ~tileMask) * level.stride + (x & ~tileMask) * tileSize + InterleaveTileBits(x & tileMask, y & tileMask) };
+		return level.offset + texelIdx * m_NrTexelWords;
+	}
+
+	void Texture::BuildMipLevels(ThreadPool* pThreadPool)
+	{
+		//box filter: every texel is the average of the 2x2 texels above it, clamped to the last row and column of odd levels
+		//row-major only
+		constexpr int rowsPerJob{ 16 };
+
+		for (int levelIdx{ 1 }; levelIdx < m_NrMipLevels; ++levelIdx)
+		{
+			const MipLevel& source{ m_MipLevels[levelIdx - 1] };
+			const MipLevel& destination{ m_MipLevels[levelIdx] };
+
+			const auto downsampleRows{ [&](uint32_t jobIdx)
+				{
+					const int firstRow{ static_cast<int>(jobIdx) * rowsPerJob };
+					const int lastRow{ std::min(firstRow + rowsPerJob, destination.height) };
+					for (int y{ firstRow }; y < lastRow; ++y)
+					{
+						const uint32_t* pRow0{ m_pTexels + GetTexelIdx(source, 0, y * 2) };
+						const uint32_t* pRow1{ m_pTexels + GetTexelIdx(source, 0, std::min(y * 2 + 1, source.height - 1)) };
+						DownsampleRow(pRow0, pRow1, source.width, m_pTexels + GetTexelIdx(destination, 0, y), destination.width, m_NrTexelWords);
+					}
+				} };
+
+			const uint32_t nrJobs{ static_cast<uint32_t>((destination.height + rowsPerJob - 1) / rowsPerJob) };
+			if (pThreadPool && destination.width * destination.height >= minParallelTexels)
+			{
+				pThreadPool->ParallelFor(nrJobs, downsampleRows);
+			}
+			else
+			{
+				for (uint32_t jobIdx{}; jobIdx < nrJobs; ++jobIdx)
+				{
+					downsampleRows(jobIdx);
+				}
+			}
+		}
+	}
+
+	int Texture::GetMipLevel(float uvLod) const
+	{
+		//nearest level, clamped to the chain (NaN picks the full resolution level)
+		const float level{ uvLod + m_LodBias + .5f };
+		return level > 0.f ? static_cast<int>(std::min(level, static_cast<float>(m_NrMipLevels - 1))) : 0;
+	}
+
+	uint32_t Texture::GetNearestTexelIdx(const Vector2& uv, int mipLevel) const
+	{
+		const MipLevel& level{ m_MipLevels[mipLevel] };
+		return GetTexelIdx(level, GetNearestTexel(uv.x, level.width), GetNearestTexel(uv.y, level.height));
+	}
+
+	void Texture::DecodeMaterialTexel(const Vector2& uv, int mipLevel, uint32_t& word0, uint32_t& word1) const
+	{
+		const MipLevel& level{ m_MipLevels[mipLevel] };
+		const int x{ GetNearestTexel(uv.x, level.width) };
+		const int y{ GetNearestTexel(uv.y, level.height) };
+
+		const uint32_t blockWordIdx{ level.offset + static_cast<uint32_t>((y / blockSize) * level.stride + x / blockSize) * blockWords };
+		const std::byte* pBlock{ reinterpret_cast<const std::byte*>(m_pTexels + blockWordIdx) };
+		const int texelIdx{ (y % blockSize) * blockSize + x % blockSize };
+
+		if (!m_UseDecodedBlockCache)
+		{
+			DecodeBlockTexel(pBlock, texelIdx, word0, word1);
+			return;
+		}
+
+		DecodedBlock& decodedBlock{ decodedBlocks[blockWordIdx / blockWords % nrDecodedBlocks] };
+		const uint64_t key{ (static_cast<uint64_t>(m_CacheId) << 32) | blockWordIdx };
+		if (decodedBlock.key != key)
+		{
+			for (int blockTexelIdx{}; blockTexelIdx < blockSize * blockSize; ++blockTexelIdx)
+			{
+				DecodeBlockTexel(pBlock, blockTexelIdx, decodedBlock.texels[blockTexelIdx][0], decodedBlock.texels[blockTexelIdx][1]);
+			}
+			decodedBlock.key = key;
+		}
+		word0 = decodedBlock.texels[texelIdx][0];
+		word1 = decodedBlock.texels[texelIdx][1];
 	}
 
 	ColorRGB Texture::Sample(const Vector2& uv) const
 	{
-		//TODO
-		//Sample the correct texel for the given uv
+		return SampleLevel(uv, 0);
+	}
+
+	ColorRGB Texture::Sample(const Vector2& uv, float uvLod) const
+	{
+		return SampleLevel(uv, GetMipLevel(uvLod));
+	}
+
+	ColorRGB Texture::SampleLevel(const Vector2& uv, int mipLevel) const
+	{
+		const uint32_t texel{ m_pTexels[GetNearestTexelIdx(uv, mipLevel)] };
+		return { ToUnorm(texel), ToUnorm(texel >> 8), ToUnorm(texel >> 16) };
+	}
+
+	Texture::MaterialSample Texture::SampleMaterial(const Vector2& uv, float uvLod) const
+	{
+		const int mipLevel{ GetMipLevel(uvLod) };
+		if (m_Format == TexelFormat::compressedMaterial)
+		{
+			uint32_t word0{};
+			uint32_t word1{};
+			DecodeMaterialTexel(uv, mipLevel, word0, word1);
+			return UnpackMaterial(word0, word1);
+		}
+
+		const uint32_t* pTexel{ m_pTexels + GetNearestTexelIdx(uv, mipLevel) };
+		return UnpackMaterial(pTexel[0], pTexel[1]);
+	}
+
+	SimdLevel Texture::GetSampleSimdLevel()
+	{
+		return GetSimdLevel() >= SimdLevel::avx2 ? SimdLevel::avx2 : SimdLevel::scalar;
+	}
+
+	void Texture::SampleBatch(const float* pU, const float* pV, const float* pUvLods, uint32_t laneMask, float* pR, float* pG, float* pB) const
+	{
+#if defined(DAE_AVX2_KERNELS)
+		//one gather for all lanes
+		if (GetSampleSimdLevel() == SimdLevel::avx2) return SampleBatchAvx2(pU, pV, pUvLods, laneMask, pR, pG, pB);
+#endif
+
+		for (; laneMask; laneMask &= laneMask - 1)
+		{
+			const int lane{ std::countr_zero(laneMask) };
+			const ColorRGB color{ Sample(Vector2{ pU[lane], pV[lane] }, pUvLods[lane]) };
+			pR[lane] = color.r;
+			pG[lane] = color.g;
+			pB[lane] = color.b;
+		}
+	}
+
+	void Texture::SampleMaterialBatch(const float* pU, const float* pV, const float* pUvLods, uint32_t laneMask, MaterialBatch& materials) const
+	{
+#if defined(DAE_AVX2_KERNELS)
+		if (GetSampleSimdLevel() == SimdLevel::avx2) return SampleMaterialBatchAvx2(pU, pV, pUvLods, laneMask, materials);
+#endif
 
-		Uint8 r{};
-		Uint8 g{};
-		Uint8 b{};
+		for (; laneMask; laneMask &= laneMask - 1)
+		{
+			const int lane{ std::countr_zero(laneMask) };
+			const MaterialSample material{ SampleMaterial(Vector2{ pU[lane], pV[lane] }, pUvLods[lane]) };
+			materials.diffuse[0][lane] = material.diffuse.r;
+			materials.diffuse[1][lane] = material.diffuse.g;
+			materials.diffuse[2][lane] = material.diffuse.b;
+			materials.normal[0][lane] = material.normal.x;
+			materials.normal[1][lane] = material.normal.y;
+			materials.normal[2][lane] = material.normal.z;
+			materials.specular[lane] = material.specular;
+			materials.glossiness[lane] = material.glossiness;
+		}
+	}
 
-		// Assuming m_pSurface->w and m_pSurface->h don't change
-		const int textureWidth = m_pSurface->w;
-		const int textureHeight = m_pSurface->h;
+#if defined(DAE_AVX2_KERNELS)
+	void Texture::SampleBatchAvx2(const float* pU, const float* pV, const float* pUvLods, uint32_t laneMask, float* pR, float* pG, float* pB) const
+	{
+		static_assert(sizeof(MipLevel) == 4 * sizeof(int) && tileSize == 4);
+		const NearestTexels nearestTexels{ GetNearestTexels(reinterpret_cast<const int*>(m_MipLevels), m_NrMipLevels, m_LodBias, pU, pV, pUvLods) };
+		const __m256i texelIdx{ GetTexelIndices(nearestTexels, m_Layout == TexelLayout::tiled, m_NrTexelWords) };
+		const __m256i texels{ _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), reinterpret_cast<const int*>(m_pTexels), texelIdx, ToLaneMask(laneMask), 4) };
 
-		// Round to the nearest integer for pixel coordinates		
-		const int xCord = static_cast<int>(std::lround(static_cast<float>(textureWidth) * uv.x + 0.5f));
-		const int yCord = static_cast<int>(std::lround(static_cast<float>(textureHeight) * uv.y + 0.5f));
+		_mm256_storeu_ps(pR, ToUnorm(texels, 0));
+		_mm256_storeu_ps(pG, ToUnorm(texels, 8));
+		_mm256_storeu_ps(pB, ToUnorm(texels, 16));
+	}
 
-		// Get the pixel index
-		const auto surfacePixelIndex = xCord + yCord * textureWidth;
-		const Uint32 pixelIndex{ m_pSurfacePixels[surfacePixelIndex] };
+	void Texture::SampleMaterialBatchAvx2(const float* pU, const float* pV, const float* pUvLods, uint32_t laneMask, MaterialBatch& materials) const
+	{
+		static_assert(sizeof(MipLevel) == 4 * sizeof(int) && tileSize == 4 && blockSize == 4);
+		const NearestTexels nearestTexels{ GetNearestTexels(reinterpret_cast<const int*>(m_MipLevels), m_NrMipLevels, m_LodBias, pU, pV, pUvLods) };
+		const __m256i gatherMask{ ToLaneMask(laneMask) };
+		const int* pWords{ reinterpret_cast<const int*>(m_pTexels) };
+
+		//the 2 words of every lane's texel in the uncompressed material format
+		__m256i words0{};
+		__m256i words1{};
+		if (m_Format == TexelFormat::compressedMaterial)
+		{
+			//DecodeBlockTexel
+			const __m256i blockIdx{ _mm256_add_epi32(_mm256_mullo_epi32(_mm256_srli_epi32(nearestTexels.y, 2), nearestTexels.stride), _mm256_srli_epi32(nearestTexels.x, 2)) };
+			const __m256i blockWordIdx{ _mm256_add_epi32(nearestTexels.offset, _mm256_mullo_epi32(blockIdx, _mm256_set1_epi32(blockWords))) };
+			const __m256i blockMask{ _mm256_set1_epi32(blockSize - 1) };
+			const __m256i texelIdx{ _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(nearestTexels.y, blockMask), 2), _mm256_and_si256(nearestTexels.x, blockMask)) };
+			const CompressedTexels compressed{ pWords, _mm256_slli_epi32(blockWordIdx, 2), texelIdx, gatherMask };
+
+			__m256i green{};
+			__m256i blue{};
+			const __m256i red{ compressed.DecodeBc1(bc1DiffuseOffset, green, blue) };
+			words0 = _mm256_or_si256(_mm256_or_si256(red, _mm256_slli_epi32(green, 8)), _mm256_or_si256(_mm256_slli_epi32(blue, 16), _mm256_slli_epi32(compressed.DecodeBc4(bc4SpecularOffset), 24)));
+			words1 = _mm256_or_si256(_mm256_or_si256(compressed.DecodeBc4(bc4NormalXOffset), _mm256_slli_epi32(compressed.DecodeBc4(bc4NormalYOffset), 8)), _mm256_slli_epi32(compressed.DecodeBc4(bc4GlossinessOffset), 16));
+		}
+		else
+		{
+			//both words of a texel are in the same cache line, the second gather hits what the first one loaded
+			const __m256i texelIdx{ GetTexelIndices(nearestTexels, m_Layout == TexelLayout::tiled, m_NrTexelWords) };
+			words0 = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), pWords, texelIdx, gatherMask, 4);
+			words1 = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), pWords + 1, texelIdx, gatherMask, 4);
+		}
 
-		SDL_GetRGB(pixelIndex, m_pSurface->format, &r, &g, &b);
+		_mm256_store_ps(materials.diffuse[0], ToUnorm(words0, 0));
+		_mm256_store_ps(materials.diffuse[1], ToUnorm(words0, 8));
+		_mm256_store_ps(materials.diffuse[2], ToUnorm(words0, 16));
+		_mm256_store_ps(materials.specular, ToUnorm(words0, 24));
 
-		return { r / 255.f, g / 255.f, b / 255.f };
+		//ToSnorm, z from x and y
+		const __m256 two{ _mm256_set1_ps(2.f) };
+		const __m256 one{ _mm256_set1_ps(1.f) };
+		const __m256 normalX{ _mm256_sub_ps(_mm256_mul_ps(two, ToUnorm(words1, 0)), one) };
+		const __m256 normalY{ _mm256_sub_ps(_mm256_mul_ps(two, ToUnorm(words1, 8)), one) };
+		const __m256 normalZSquared{ _mm256_sub_ps(_mm256_sub_ps(one, _mm256_mul_ps(normalX, normalX)), _mm256_mul_ps(normalY, normalY)) };
+		_mm256_store_ps(materials.normal[0], normalX);
+		_mm256_store_ps(materials.normal[1], normalY);
+		_mm256_store_ps(materials.normal[2], _mm256_sqrt_ps(_mm256_max_ps(normalZSquared, _mm256_setzero_ps())));
+		_mm256_store_ps(materials.glossiness, ToUnorm(words1, 16));
 	}
-}
\ No newline at end of file
+#endif
+}
@@ -1,24 +1,160 @@
 #pragma once
-#include <SDL_surface.h>
+#include <cstdint>
 #include <string>
 #include "ColorRGB.h"
+#include "CpuFeatures.h"
+#include "Vector3.h"
 
 namespace dae
 {
 	struct Vector2;
+	class ThreadPool;
 
 	class Texture
 	{
 	public:
 		~Texture();
 
-		static Texture* LoadFromFile(const std::string& path);
+		Texture(const Texture&) = delete;
+		Texture(Texture&&) noexcept = delete;
+		Texture& operator=(const Texture&) = delete;
+		Texture& operator=(Texture&&) noexcept = delete;
+
+		//how the texels of a level are ordered in memory
+		enum class TexelLayout
+		{
+			rowMajor,
+			tiled	//4x4 tiles of one cache line each, z-order inside a tile: walking down a column stays in the same line for 4 texels
+		};
+
+		//how a material texture stores its texels
+		enum class MaterialFormat
+		{
+			uncompressed,	//8 bytes per texel
+			compressed		//4x4 blocks of BC1 diffuse, BC4 specular, BC5 normal and BC4 glossiness: 2.5 bytes per texel, always in block order
+		};
+
+		//everything a material texture holds for one texel
+		struct MaterialSample
+		{
+			ColorRGB diffuse{};
+			Vector3 normal{};	//tangent space, z reconstructed from x and y
+			float specular{};
+			float glossiness{};
+		};
+
+		//8 material samples in structure-of-arrays form
+		struct MaterialBatch
+		{
+			alignas(32) float diffuse[3][8];
+			alignas(32) float normal[3][8];
+			alignas(32) float specular[8];
+			alignas(32) float glossiness[8];
+		};
+
+		//converts whatever format the file has to RGBA8 once and builds the mip chain, sampling never goes through SDL
+		//large levels are downsampled on the thread pool when one is given
+		static Texture* LoadFromFile(const std::string& path, ThreadPool* pThreadPool = nullptr, TexelLayout layout = TexelLayout::rowMajor);
+		//packs 4 maps of the same size into one material texture: 8 bytes per texel, a sample is a single cache line
+		//RGB8 diffuse + R8 specular, RG8 tangent space normal + R8 glossiness
+		//compressed: every mip level is block compressed at load, the layout is ignored
+		static Texture* LoadMaterialFromFiles(const std::string& diffusePath, const std::string& normalPath, const std::string& specularPath, const std::string& glossinessPath,
+			ThreadPool* pThreadPool = nullptr, TexelLayout layout = TexelLayout::rowMajor, MaterialFormat format = MaterialFormat::uncompressed);
+		//the same from 4 row-major RGBA8 maps already in memory, red in the lowest byte
+		static Texture* CreateMaterial(int width, int height, const uint32_t* pDiffuseMap, const uint32_t* pNormalMap, const uint32_t* pSpecularMap, const uint32_t* pGlossinessMap,
+			ThreadPool* pThreadPool = nullptr, TexelLayout layout = TexelLayout::rowMajor, MaterialFormat format = MaterialFormat::uncompressed);
+
+		//nearest texel of the full resolution level
 		ColorRGB Sample(const Vector2& uv) const;
+		//nearest texel of the mip level for uvLod: log2 of the uv distance between neighbouring pixels
+		ColorRGB Sample(const Vector2& uv, float uvLod) const;
+		//8 lookups in structure-of-arrays form, same texels and colors as Sample, lanes outside laneMask are skipped
+		void SampleBatch(const float* pU, const float* pV, const float* pUvLods, uint32_t laneMask, float* pR, float* pG, float* pB) const;
+		//nearest texel of a material texture, see Sample for uvLod
+		MaterialSample SampleMaterial(const Vector2& uv, float uvLod) const;
+		//8 lookups of a material texture, same texels and values as SampleMaterial, lanes outside laneMask are skipped
+		void SampleMaterialBatch(const float* pU, const float* pV, const float* pUvLods, uint32_t laneMask, MaterialBatch& materials) const;
+		//the instruction set SampleBatch and SampleMaterialBatch run with: an AVX2 gather or one Sample per lane
+		static SimdLevel GetSampleSimdLevel();
+
+		int GetWidth() const { return m_MipLevels[0].width; }
+		int GetHeight() const { return m_MipLevels[0].height; }
+		int GetNrMipLevels() const { return m_NrMipLevels; }
+		TexelLayout GetTexelLayout() const { return m_Layout; }
+		//of all mip levels
+		size_t GetSizeInBytes() const { return m_NrWords * sizeof(uint32_t); }
+
+		//compressed materials: SampleMaterial decodes whole blocks into a small per-thread cache instead of single texels
+		//pays off when neighbouring samples hit the same block, SampleMaterialBatch always decodes single texels
+		void SetDecodedBlockCache(bool isEnabled) { m_UseDecodedBlockCache = isEnabled; }
 
 	private:
-		Texture(SDL_Surface* pSurface);
+		//the texel formats: Sample* only works on rgba8, SampleMaterial* only on material
+		enum class TexelFormat
+		{
+			rgba8,
+			material,
+			compressedMaterial
+		};
+
+		Texture(int width, int height, TexelLayout layout, TexelFormat format = TexelFormat::rgba8);
+
+		//a row-major rgba8 texture with only the full resolution level filled
+		static Texture* LoadTexels(const std::string& path);
+		//builds the mip chain and moves the texels to the requested layout
+		static Texture* Finish(Texture* pTexture, ThreadPool* pThreadPool, TexelLayout layout);
+		//encodes every level of a row-major material texture
+		static Texture* Compress(const Texture& material, ThreadPool* pThreadPool);
+
+		//every level halves the size of the one above (rounded up), down to 1x1
+		struct MipLevel
+		{
+			int width{};
+			int height{};
+			int stride{};		//row-major: texels per row, tiled: the width rounded up to whole tiles, compressed: blocks per row
+			uint32_t offset{};	//of its first word in m_pTexels
+		};
+
+		static constexpr int tileSize{ 4 };
+		//compressed materials: 4x4 texels per block, 40 bytes
+		static constexpr int blockSize{ 4 };
+		static constexpr int blockWords{ 10 };
+
+		//enough for 32K textures
+		static constexpr int maxMipLevels{ 16 };
+		//every level starts on a cache line
+		static constexpr size_t texelAlignment{ 64 };
+
+		void BuildMipLevels(ThreadPool* pThreadPool);
+		//the same texels in this texture's layout, both have the same size and format
+		void CopyTexels(const Texture& source);
+		int GetMipLevel(float uvLod) const;
+		//index of the first word of a texel in m_pTexels
+		uint32_t GetTexelIdx(const MipLevel& level, int x, int y) const;
+		uint32_t GetNearestTexelIdx(const Vector2& uv, int mipLevel) const;
+		//compressed materials: the texel's 2 words in the uncompressed material format
+		void DecodeMaterialTexel(const Vector2& uv, int mipLevel, uint32_t& word0, uint32_t& word1) const;
+		ColorRGB SampleLevel(const Vector2& uv, int mipLevel) const;
+#if defined(DAE_AVX2_KERNELS)
+		//the AVX2 bodies of SampleBatch and SampleMaterialBatch
+		DAE_TARGET_AVX2 void SampleBatchAvx2(const float* pU, const float* pV, const float* pUvLods, uint32_t laneMask, float* pR, float* pG, float* pB) const;
+		DAE_TARGET_AVX2 void SampleMaterialBatchAvx2(const float* pU, const float* pV, const float* pUvLods, uint32_t laneMask, MaterialBatch& materials) const;
+#endif
 
-		SDL_Surface* m_pSurface{ nullptr };
-		uint32_t* m_pSurfacePixels{ nullptr };
+		MipLevel m_MipLevels[maxMipLevels]{};
+		int m_NrMipLevels{};
+		//log2 of the texels per uv unit: the mip level is uvLod + m_LodBias
+		float m_LodBias{};
+		TexelLayout m_Layout{};
+		TexelFormat m_Format{};
+		//32-bit words per texel, 0 for compressed materials
+		int m_NrTexelWords{};
+		uint32_t m_NrWords{};
+		bool m_UseDecodedBlockCache{};
+		//tells the textures apart in the decoded block cache, unlike addresses they are never reused
+		uint32_t m_CacheId{};
+		//all levels, rgba8: RGBA with red in the lowest byte, material: 2 words in the order of LoadMaterialFromFiles
+		//compressed material: the blocks of a level row by row
+		uint32_t* m_pTexels{};
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,104 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+namespace dae
+{
+	ThreadPool::ThreadPool(uint32_t nrThreads)
+	{
+		//hardware_concurrency may return 0 when it can't tell
+		nrThreads = std::max(nrThreads, 1u);
+
+		m_Workers.reserve(nrThreads - 1);
+		for (uint32_t i{ 1 }; i < nrThreads; ++i)
+		{
+			m_Workers.emplace_back(&ThreadPool::WorkerLoop, this);
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard lock{ m_Mutex };
+			m_IsStopping = true;
+		}
+		m_WakeCondition.notify_all();
+
+		for (std::thread& worker : m_Workers)
+		{
+			worker.join();
+		}
+	}
+
+	void ThreadPool::ParallelFor(uint32_t count, const JobRef& job)
+	{
+		if (count == 0) return;
+
+		if (m_Workers.empty() || count == 1)
+		{
+			for (uint32_t i{}; i < count; ++i)
+			{
+				job(i);
+			}
+			return;
+		}
+
+		{
+			std::lock_guard lock{ m_Mutex };
+			m_pJob = &job;
+			m_JobCount = count;
+			m_NextIndex = 0;
+			m_NrDone = 0;
+			++m_Generation;
+		}
+		m_WakeCondition.notify_all();
+
+		RunJobs(job, count);
+
+		//wait until every index is finished and no worker still holds a pointer to the job
+		std::unique_lock lock{ m_Mutex };
+		m_DoneCondition.wait(lock, [this] { return m_NrDone == m_JobCount && m_NrBusyWorkers == 0; });
+		m_pJob = nullptr;
+	}
+
+	void ThreadPool::WorkerLoop()
+	{
+		uint64_t seenGeneration{};
+		while (true)
+		{
+			const JobRef* pJob{};
+			uint32_t count{};
+			{
+				std::unique_lock lock{ m_Mutex };
+				m_WakeCondition.wait(lock, [&] { return m_IsStopping || m_Generation != seenGeneration; });
+				if (m_IsStopping) return;
+
+				seenGeneration = m_Generation;
+
+				//woke up too late, the job already finished without us
+				if (!m_pJob) continue;
+
+				pJob = m_pJob;
+				count = m_JobCount;
+				++m_NrBusyWorkers;
+			}
+
+			RunJobs(*pJob, count);
+
+			{
+				std::lock_guard lock{ m_Mutex };
+				--m_NrBusyWorkers;
+			}
+			m_DoneCondition.notify_one();
+		}
+	}
+
+	void ThreadPool::RunJobs(const JobRef& job, uint32_t count)
+	{
+		for (uint32_t i{ m_NextIndex++ }; i < count; i = m_NextIndex++)
+		{
+			job(i);
+			++m_NrDone;
+		}
+	}
+}
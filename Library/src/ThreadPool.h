@@ -0,0 +1,61 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dae
+{
+	class ThreadPool final
+	{
+	public:
+		explicit ThreadPool(uint32_t nrThreads = std::thread::hardware_concurrency());
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool(ThreadPool&&) noexcept = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+		ThreadPool& operator=(ThreadPool&&) noexcept = delete;
+
+		//calls job(index) for every index in [0, count) spread over all threads, returns when every index is done
+		//the calling thread helps out, so a pool of 1 thread runs everything inline
+		//the job is only referenced, never copied, so any lambda works without a heap allocation
+		template<typename Job>
+		void ParallelFor(uint32_t count, const Job& job)
+		{
+			ParallelFor(count, JobRef{ &job, [](const void* pJob, uint32_t index) { (*static_cast<const Job*>(pJob))(index); } });
+		}
+
+		uint32_t GetNrThreads() const { return static_cast<uint32_t>(m_Workers.size()) + 1; }
+
+	private:
+		//type erased reference to the job of a ParallelFor call
+		struct JobRef
+		{
+			const void* pJob{};
+			void (*pInvoke)(const void*, uint32_t) {};
+
+			void operator()(uint32_t index) const { pInvoke(pJob, index); }
+		};
+
+		void ParallelFor(uint32_t count, const JobRef& job);
+		void WorkerLoop();
+		void RunJobs(const JobRef& job, uint32_t count);
+
+		std::vector<std::thread> m_Workers{};
+
+		std::mutex m_Mutex{};
+		std::condition_variable m_WakeCondition{};
+		std::condition_variable m_DoneCondition{};
+
+		const JobRef* m_pJob{ nullptr };
+		uint32_t m_JobCount{};
+		std::atomic<uint32_t> m_NextIndex{};
+		std::atomic<uint32_t> m_NrDone{};
+		uint64_t m_Generation{};
+		uint32_t m_NrBusyWorkers{};
+		bool m_IsStopping{ false };
+	};
+}
@@ -0,0 +1,62 @@
+#include "AllocationCounter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+	std::atomic<uint64_t> g_NrHeapAllocations{};
+
+	void* AllocateCounted(std::size_t size)
+	{
+		g_NrHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+
+		if (void* pMemory{ std::malloc(size > 0 ? size : 1) }) return pMemory;
+		throw std::bad_alloc{};
+	}
+
+	void* AllocateCounted(std::size_t size, std::align_val_t alignment)
+	{
+		g_NrHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+
+		//aligned_alloc wants the size to be a multiple of the alignment, msvc has its own aligned heap
+		const std::size_t alignedSize{ (std::max(size, std::size_t{ 1 }) + static_cast<std::size_t>(alignment) - 1) & ~(static_cast<std::size_t>(alignment) - 1) };
+#if defined(_MSC_VER)
+		if (void* pMemory{ _aligned_malloc(alignedSize, static_cast<std::size_t>(alignment)) }) return pMemory;
+#else
+		if (void* pMemory{ std::aligned_alloc(static_cast<std::size_t>(alignment), alignedSize) }) return pMemory;
+#endif
+		throw std::bad_alloc{};
+	}
+
+	void FreeAligned(void* pMemory)
+	{
+#if defined(_MSC_VER)
+		_aligned_free(pMemory);
+#else
+		std::free(pMemory);
+#endif
+	}
+}
+
+uint64_t dae::GetNrHeapAllocations()
+{
+	return g_NrHeapAllocations.load(std::memory_order_relaxed);
+}
+
+//the replaceable global allocation functions, the nothrow forms call these
+void* operator new(std::size_t size) { return AllocateCounted(size); }
+void* operator new[](std::size_t size) { return AllocateCounted(size); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return AllocateCounted(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return AllocateCounted(size, alignment); }
+
+void operator delete(void* pMemory) noexcept { std::free(pMemory); }
+void operator delete[](void* pMemory) noexcept { std::free(pMemory); }
+void operator delete(void* pMemory, std::size_t) noexcept { std::free(pMemory); }
+void operator delete[](void* pMemory, std::size_t) noexcept { std::free(pMemory); }
+void operator delete(void* pMemory, std::align_val_t) noexcept { FreeAligned(pMemory); }
+void operator delete[](void* pMemory, std::align_val_t) noexcept { FreeAligned(pMemory); }
+void operator delete(void* pMemory, std::size_t, std::align_val_t) noexcept { FreeAligned(pMemory); }
+void operator delete[](void* pMemory, std::size_t, std::align_val_t) noexcept { FreeAligned(pMemory); }
@@ -0,0 +1,9 @@
+#pragma once
+#include <cstdint>
+
+namespace dae
+{
+	//heap allocations made through operator new since the start of the program, on every thread
+	//the global operator new of the executable is replaced to count them, malloc from C libraries (SDL) is not counted
+	uint64_t GetNrHeapAllocations();
+}
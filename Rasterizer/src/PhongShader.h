@@ -0,0 +1,329 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "Shader.h"
+#include "Simd.h"
+#include "Texture.h"
+
+namespace dae
+{
+	enum class ShadingMode
+	{
+		observed,
+		diffuse,
+		specular,
+		combined
+	};
+
+	//each shading mode only declares the varyings it reads, the rest is never interpolated
+	struct ObservedAreaVaryings
+	{
+		Vector3 normal{};
+	};
+	struct DiffuseVaryings
+	{
+		Vector2 uv{};
+		Vector3 normal{};
+	};
+	//the view direction points from the surface to the camera, it is linear in world space
+	//so it is interpolated unnormalized and normalized per pixel
+	struct SpecularVaryings
+	{
+		Vector2 uv{};
+		Vector3 normal{};
+		Vector3 viewDirection{};
+	};
+	struct NormalMappedVaryings
+	{
+		Vector2 uv{};
+		Vector3 normal{};
+		Vector3 tangent{};
+	};
+	struct NormalMappedSpecularVaryings
+	{
+		Vector2 uv{};
+		Vector3 normal{};
+		Vector3 tangent{};
+		Vector3 viewDirection{};
+	};
+
+	template<ShadingMode shadingMode, bool useNormalMap>
+	using PhongVaryings = std::conditional_t<shadingMode == ShadingMode::specular || shadingMode == ShadingMode::combined,
+		std::conditional_t<useNormalMap, NormalMappedSpecularVaryings, SpecularVaryings>,
+		std::conditional_t<useNormalMap, NormalMappedVaryings, std::conditional_t<shadingMode == ShadingMode::observed, ObservedAreaVaryings, DiffuseVaryings>>>;
+
+	//world space normal, tangent and view direction, fills every field the varyings struct declares
+	template<ShaderVaryings Varyings>
+	struct PhongVertexShader
+	{
+		Matrix worldViewProjectionMatrix{};
+		Matrix worldMatrix{};
+		Vector3 cameraOrigin{};
+
+		Vector4 TransformPosition(const Vector3& position) const
+		{
+			return worldViewProjectionMatrix.TransformPoint({ position, 1.0f });
+		}
+
+		void TransformPositions(std::span<const Vector3> positions, std::span<Vector4> positions_out) const
+		{
+			worldViewProjectionMatrix.TransformPoints(positions, positions_out);
+		}
+
+		Varyings ComputeVaryings(const VertexStreams& vertices, uint32_t vertexIdx) const
+		{
+			Varyings varyings{};
+			if constexpr (requires { varyings.uv; }) varyings.uv = vertices.uvs[vertexIdx];
+			if constexpr (requires { varyings.normal; }) varyings.normal = worldMatrix.TransformVector(vertices.normals[vertexIdx]);
+			if constexpr (requires { varyings.tangent; }) varyings.tangent = worldMatrix.TransformVector(vertices.tangents[vertexIdx]);
+			if constexpr (requires { varyings.viewDirection; }) varyings.viewDirection = cameraOrigin - worldMatrix.TransformPoint(vertices.positions[vertexIdx]);
+			return varyings;
+		}
+
+		//the same for up to maxVaryingsBatchSize vertices, the normals and tangents go through Matrix::TransformVectors
+		void ComputeVaryingsBatch(const VertexStreams& vertices, std::span<const uint32_t> vertexIndices, Varyings* varyings_out) const
+		{
+			for (const uint32_t vertexIdx : vertexIndices)
+			{
+				Varyings& varyings{ varyings_out[vertexIdx] };
+				varyings = {};
+				if constexpr (requires { varyings.uv; }) varyings.uv = vertices.uvs[vertexIdx];
+				if constexpr (requires { varyings.viewDirection; }) varyings.viewDirection = cameraOrigin - worldMatrix.TransformPoint(vertices.positions[vertexIdx]);
+			}
+			if constexpr (requires { &Varyings::normal; }) TransformAttribute(vertices.normals, vertexIndices, varyings_out, &Varyings::normal);
+			if constexpr (requires { &Varyings::tangent; }) TransformAttribute(vertices.tangents, vertexIndices, varyings_out, &Varyings::tangent);
+		}
+
+		//gathers an attribute of the vertices, transforms it in place and scatters it into its field of the varyings
+		void TransformAttribute(const std::vector<Vector3>& attributes, std::span<const uint32_t> vertexIndices, Varyings* varyings_out, Vector3 Varyings::* pField) const
+		{
+			Vector3 vectors[maxVaryingsBatchSize];
+			const std::span<Vector3> batch{ vectors, vertexIndices.size() };
+			for (size_t i{}; i < batch.size(); ++i)
+			{
+				batch[i] = attributes[vertexIndices[i]];
+			}
+
+			worldMatrix.TransformVectors(batch, batch);
+
+			for (size_t i{}; i < batch.size(); ++i)
+			{
+				varyings_out[vertexIndices[i]].*pField = batch[i];
+			}
+		}
+	};
+
+	//the built-in vehicle material: lambert diffuse + phong specular with a glossiness map
+	template<ShadingMode shadingMode, bool useNormalMap>
+	struct PhongPixelShader
+	{
+		using Varyings = PhongVaryings<shadingMode, useNormalMap>;
+
+		//diffuse, normal, specular and glossiness maps interleaved, see Texture::LoadMaterialFromFiles
+		const Texture* pMaterial{};
+
+		//only the observed area mode without normal map reads no texture (and has no uv)
+		static constexpr bool usesMaterial{ useNormalMap || shadingMode != ShadingMode::observed };
+
+		ColorRGB Shade(const Varyings& varyings, float uvLod) const
+		{
+			Vector3 lightDirection{ .557f,-.557f,.557f };
+
+			lightDirection.Normalize();
+			constexpr float lightIntensity{ 2.f };
+			constexpr float specularShininess{ 25.f };
+
+			Vector3 normal{ varyings.normal.Normalized() };
+
+			//every map of the fragment in one fetch
+			Texture::MaterialSample material{};
+			if constexpr (usesMaterial) material = pMaterial->SampleMaterial(varyings.uv, uvLod);
+
+			if constexpr (useNormalMap)
+			{
+				const Vector3 tangent{ varyings.tangent.Normalized() };
+				const Vector3 biNormal = Vector3::Cross(normal, tangent);
+				const Matrix tangentSpaceAxis = { tangent, biNormal, normal, Vector3::Zero };
+
+				const Vector3 sampledNormal = tangentSpaceAxis.TransformVector(material.normal);
+
+				normal = sampledNormal.Normalized();
+			}
+
+
+			// OBSERVED AREA
+			float ObservedArea{ Vector3::Dot(normal,  -lightDirection) };
+			ObservedArea = std::max(ObservedArea, 0.f);
+
+			const ColorRGB observedAreaRGB{ ObservedArea ,ObservedArea ,ObservedArea };
+
+			//generic so modes without a view direction never instantiate it
+			const auto sampleSpecular = [&](const auto& specularVaryings)
+				{
+					const Vector3 reflect{ Vector3::Reflect(lightDirection, normal) };
+					float cosAlpha{ Vector3::Dot(reflect, specularVaryings.viewDirection.Normalized()) };
+					cosAlpha = std::max(0.f, cosAlpha);
+
+					const float specularExp{ specularShininess * material.glossiness };
+
+					const float specular{ material.specular * powf(cosAlpha, specularExp) };
+					return ColorRGB{ specular, specular, specular };
+				};
+
+			ColorRGB finalColor{ 0,0,0 };
+
+			if constexpr (shadingMode == ShadingMode::observed)
+			{
+				finalColor += observedAreaRGB;
+			}
+			else if constexpr (shadingMode == ShadingMode::diffuse)
+			{
+				// DIFFUSE
+				const ColorRGB TextureColor{ material.diffuse };
+				finalColor += lightIntensity * observedAreaRGB * TextureColor / PI;
+			}
+			else if constexpr (shadingMode == ShadingMode::specular)
+			{
+				// SPECULAR
+				finalColor += sampleSpecular(varyings); // *observedAreaRGB;
+			}
+			else
+			{
+				const ColorRGB TextureColor{ material.diffuse };
+				finalColor += (lightIntensity * TextureColor / PI + sampleSpecular(varyings)) * observedAreaRGB;
+			}
+
+			const ColorRGB ambient{ .05f,.05f,.05f };
+			finalColor += ambient;
+			finalColor.MaxToOne();
+
+			return finalColor;
+		}
+
+#if defined(DAE_AVX2_KERNELS)
+		//Shade for 8 fragments at once, the same math with every lane in its own simd lane
+		DAE_TARGET_AVX2 void ShadeBatch(const FragmentBatch& fragments, ColorBatch& colors) const
+		{
+			const auto loadVector = [&](size_t offset) DAE_TARGET_AVX2
+				{
+					const size_t varyingIdx{ offset / sizeof(float) };
+					return Vector3x8{ _mm256_load_ps(fragments.varyings[varyingIdx]), _mm256_load_ps(fragments.varyings[varyingIdx + 1]), _mm256_load_ps(fragments.varyings[varyingIdx + 2]) };
+				};
+
+			//every map of all lanes in one batch lookup, the uv varyings already are structure-of-arrays
+			Texture::MaterialBatch material;
+			if constexpr (usesMaterial)
+			{
+				const size_t uvIdx{ offsetof(Varyings, uv) / sizeof(float) };
+				pMaterial->SampleMaterialBatch(fragments.varyings[uvIdx], fragments.varyings[uvIdx + 1], fragments.uvLods, fragments.laneMask, material);
+			}
+
+			Vector3 lightDirection{ .557f,-.557f,.557f };
+			lightDirection.Normalize();
+			const Vector3x8 toLight{ Broadcast(-lightDirection) };
+			const __m256 lightIntensity{ _mm256_set1_ps(2.f) };
+			const __m256 specularShininess{ _mm256_set1_ps(25.f) };
+			const __m256 pi{ _mm256_set1_ps(PI) };
+
+			Vector3x8 normal{ Normalized(loadVector(offsetof(Varyings, normal))) };
+
+			if constexpr (useNormalMap)
+			{
+				const Vector3x8 tangent{ Normalized(loadVector(offsetof(Varyings, tangent))) };
+				const Vector3x8 biNormal{ Cross(normal, tangent) };
+
+				//from tangent space to world space
+				const __m256 sampledX{ _mm256_load_ps(material.normal[0]) };
+				const __m256 sampledY{ _mm256_load_ps(material.normal[1]) };
+				const __m256 sampledZ{ _mm256_load_ps(material.normal[2]) };
+
+				normal = Normalized(
+					{
+						MulAdd(tangent.x, sampledX, MulAdd(biNormal.x, sampledY, _mm256_mul_ps(normal.x, sampledZ))),
+						MulAdd(tangent.y, sampledX, MulAdd(biNormal.y, sampledY, _mm256_mul_ps(normal.y, sampledZ))),
+						MulAdd(tangent.z, sampledX, MulAdd(biNormal.z, sampledY, _mm256_mul_ps(normal.z, sampledZ)))
+					});
+			}
+
+			// OBSERVED AREA
+			const __m256 observedArea{ _mm256_max_ps(Dot(normal, toLight), _mm256_setzero_ps()) };
+
+			__m256 red{ _mm256_setzero_ps() };
+			__m256 green{ _mm256_setzero_ps() };
+			__m256 blue{ _mm256_setzero_ps() };
+
+			//only the modes with a view direction have a specular term
+			const auto sampleSpecular = [&](__m256& specularRed, __m256& specularGreen, __m256& specularBlue) DAE_TARGET_AVX2
+				{
+					//the view direction only exists in the varyings of the specular modes
+					if constexpr (shadingMode == ShadingMode::specular || shadingMode == ShadingMode::combined)
+					{
+						//reflect(l, n) = l - 2 * dot(l, n) * n
+						const __m256 reflectScale{ _mm256_mul_ps(_mm256_set1_ps(2.f), Dot(Broadcast(lightDirection), normal)) };
+						const Vector3x8 reflect
+						{
+							_mm256_sub_ps(_mm256_set1_ps(lightDirection.x), _mm256_mul_ps(reflectScale, normal.x)),
+							_mm256_sub_ps(_mm256_set1_ps(lightDirection.y), _mm256_mul_ps(reflectScale, normal.y)),
+							_mm256_sub_ps(_mm256_set1_ps(lightDirection.z), _mm256_mul_ps(reflectScale, normal.z))
+						};
+						const __m256 cosAlpha{ _mm256_max_ps(Dot(reflect, Normalized(loadVector(offsetof(Varyings, viewDirection)))), _mm256_setzero_ps()) };
+
+						const __m256 phong{ Pow(cosAlpha, _mm256_mul_ps(specularShininess, _mm256_load_ps(material.glossiness))) };
+						specularRed = _mm256_mul_ps(_mm256_load_ps(material.specular), phong);
+						specularGreen = specularRed;
+						specularBlue = specularRed;
+					}
+				};
+
+			if constexpr (shadingMode == ShadingMode::observed)
+			{
+				red = observedArea;
+				green = observedArea;
+				blue = observedArea;
+			}
+			else if constexpr (shadingMode == ShadingMode::diffuse)
+			{
+				// DIFFUSE
+				const __m256 lambert{ _mm256_mul_ps(lightIntensity, observedArea) };
+				red = _mm256_div_ps(_mm256_mul_ps(lambert, _mm256_load_ps(material.diffuse[0])), pi);
+				green = _mm256_div_ps(_mm256_mul_ps(lambert, _mm256_load_ps(material.diffuse[1])), pi);
+				blue = _mm256_div_ps(_mm256_mul_ps(lambert, _mm256_load_ps(material.diffuse[2])), pi);
+			}
+			else if constexpr (shadingMode == ShadingMode::specular)
+			{
+				// SPECULAR
+				sampleSpecular(red, green, blue);
+			}
+			else
+			{
+				__m256 specularRed{};
+				__m256 specularGreen{};
+				__m256 specularBlue{};
+				sampleSpecular(specularRed, specularGreen, specularBlue);
+
+				red = _mm256_mul_ps(_mm256_add_ps(_mm256_div_ps(_mm256_mul_ps(lightIntensity, _mm256_load_ps(material.diffuse[0])), pi), specularRed), observedArea);
+				green = _mm256_mul_ps(_mm256_add_ps(_mm256_div_ps(_mm256_mul_ps(lightIntensity, _mm256_load_ps(material.diffuse[1])), pi), specularGreen), observedArea);
+				blue = _mm256_mul_ps(_mm256_add_ps(_mm256_div_ps(_mm256_mul_ps(lightIntensity, _mm256_load_ps(material.diffuse[2])), pi), specularBlue), observedArea);
+			}
+
+			const __m256 ambient{ _mm256_set1_ps(.05f) };
+			red = _mm256_add_ps(red, ambient);
+			green = _mm256_add_ps(green, ambient);
+			blue = _mm256_add_ps(blue, ambient);
+
+			//MaxToOne
+			const __m256 maxValue{ _mm256_max_ps(red, _mm256_max_ps(green, blue)) };
+			const __m256 scale{ _mm256_blendv_ps(_mm256_set1_ps(1.f), maxValue, _mm256_cmp_ps(maxValue, _mm256_set1_ps(1.f), _CMP_GT_OQ)) };
+			_mm256_store_ps(colors.r, _mm256_div_ps(red, scale));
+			_mm256_store_ps(colors.g, _mm256_div_ps(green, scale));
+			_mm256_store_ps(colors.b, _mm256_div_ps(blue, scale));
+		}
+#endif
+	};
+}
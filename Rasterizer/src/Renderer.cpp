@@ -2,16 +2,121 @@
 #include "SDL.h"
 #include "SDL_surface.h"
 
+//Standard includes
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
 //Project includes
 #include "Renderer.h"
+#if defined(DAE_AVX2_KERNELS)
+#include <immintrin.h>
+#endif
 
 
 #include "Maths.h"
+#include "Simd.h"
 #include "Texture.h"
+#include "ThreadPool.h"
 #include "Utils.h"
 
 using namespace dae;
 
+namespace
+{
+	//hi-z bounds are estimated from the depth plane at the block corners, the kernel rounds differently
+	//-> every comparison keeps this much slack so an estimate is never tighter than the real depth
+	constexpr float hiZSlack{ 1e-6f };
+
+	//visibility buffer value of pixels no triangle covers
+	constexpr uint32_t invalidTriangleIdx{ UINT32_MAX };
+
+	//vertices per job of the parallel vertex stage, small meshes run inline on the calling thread
+	constexpr uint32_t vertexChunkSize{ 4096 };
+
+	//tiles are walked in 8x8 pixel blocks, one bit per pixel in a 64-bit coverage mask
+	constexpr int blockSize{ 8 };
+
+	//varyings are a plain struct of floats, lerped float by float
+	template<ShaderVaryings Varyings>
+	Varyings LerpVaryings(const Varyings& varyings0, const Varyings& varyings1, float t)
+	{
+		float floats0[nrVaryingFloats<Varyings>]{};
+		float floats1[nrVaryingFloats<Varyings>]{};
+		std::memcpy(floats0, &varyings0, sizeof(Varyings));
+		std::memcpy(floats1, &varyings1, sizeof(Varyings));
+
+		for (int floatIdx{}; floatIdx < nrVaryingFloats<Varyings>; ++floatIdx)
+		{
+			floats0[floatIdx] = floats0[floatIdx] + (floats1[floatIdx] - floats0[floatIdx]) * t;
+		}
+
+		Varyings varyings{};
+		std::memcpy(&varyings, floats0, sizeof(Varyings));
+		return varyings;
+	}
+
+	//the pixel shader bytes of a draw call, kernels that never shade take it as void
+	template<typename PixelShaderType>
+	const PixelShaderType* GetPixelShader(const void* pPixelShader)
+	{
+		if constexpr (std::is_void_v<PixelShaderType>) return pPixelShader;
+		else return std::launder(static_cast<const PixelShaderType*>(pPixelShader));
+	}
+
+#if defined(DAE_AVX2_KERNELS)
+	//the pixels of rows [firstRow, lastRow) of a block inside one edge, rowWeight is the edge value at the first pixel of firstRow
+	DAE_TARGET_AVX2 uint64_t ComputeEdgeCoverageAvx2(const EdgeFunction& edge, int64_t rowWeight, int firstRow, int lastRow)
+	{
+		//8 exact 64-bit edge values per row, the sign bits are the pixels outside
+		const __m256i stepsLow{ _mm256_setr_epi64x(0, edge.stepX, edge.stepX * 2, edge.stepX * 3) };
+		const __m256i stepsHigh{ _mm256_setr_epi64x(edge.stepX * 4, edge.stepX * 5, edge.stepX * 6, edge.stepX * 7) };
+
+		uint64_t edgeCoverage{};
+		for (int row{ firstRow }; row < lastRow; ++row, rowWeight += edge.stepY)
+		{
+			const __m256i weight{ _mm256_set1_epi64x(rowWeight) };
+			const int outsideLow{ _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_add_epi64(weight, stepsLow))) };
+			const int outsideHigh{ _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_add_epi64(weight, stepsHigh))) };
+
+			edgeCoverage |= static_cast<uint64_t>(~(outsideLow | (outsideHigh << 4)) & 0xFF) << (row * blockSize);
+		}
+		return edgeCoverage;
+	}
+
+	//MaxToOne + SDL_MapRGB for the lanes in passMask, only for 32-bit pixels with 8-bit channels
+	DAE_TARGET_AVX2 void StorePixelsAvx2(const ColorBatch& colors, uint32_t passMask, const SDL_PixelFormat* pFormat, uint32_t* pPixels)
+	{
+		const __m256 r{ _mm256_load_ps(colors.r) };
+		const __m256 g{ _mm256_load_ps(colors.g) };
+		const __m256 b{ _mm256_load_ps(colors.b) };
+
+		//same operand order as std::max, so NaN lanes pick the same value
+		const __m256 maxValue{ _mm256_max_ps(_mm256_max_ps(b, g), r) };
+		const __m256 isAboveOne{ _mm256_cmp_ps(maxValue, _mm256_set1_ps(1.f), _CMP_GT_OQ) };
+
+		//the cast to uint8_t truncates and keeps the low byte of the integer
+		const auto toChannel = [&](__m256 channel, uint8_t shift) DAE_TARGET_AVX2
+			{
+				channel = _mm256_blendv_ps(channel, _mm256_div_ps(channel, maxValue), isAboveOne);
+				const __m256i value{ _mm256_and_si256(_mm256_cvttps_epi32(_mm256_mul_ps(channel, _mm256_set1_ps(255.f))), _mm256_set1_epi32(0xFF)) };
+				return _mm256_sll_epi32(value, _mm_cvtsi32_si128(shift));
+			};
+		const __m256i pixels{ _mm256_or_si256(_mm256_or_si256(toChannel(r, pFormat->Rshift), toChannel(g, pFormat->Gshift)),
+			_mm256_or_si256(toChannel(b, pFormat->Bshift), _mm256_set1_epi32(static_cast<int>(pFormat->Amask)))) };
+
+		const __m256i laneBits{ _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128) };
+		const __m256i storeMask{ _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(static_cast<int>(passMask)), laneBits), laneBits) };
+		_mm256_maskstore_epi32(reinterpret_cast<int*>(pPixels), storeMask, pixels);
+	}
+#endif
+}
+
 Renderer::Renderer(SDL_Window* pWindow) :
 	m_pWindow(pWindow)
 {
@@ -25,7 +130,23 @@ Renderer::Renderer(SDL_Window* pWindow) :
 	m_pBackBufferPixels = (uint32_t*)m_pBackBuffer->pixels;
 
 	
-	m_pDepthBufferPixels = new float[static_cast<float>(m_Width * m_Height)];
+	m_pDepthBufferPixels = new float[m_Width * m_Height];
+	m_pVisibilityBuffer = new uint32_t[m_Width * m_Height];
+
+	//screen tiles for the binned rasterizer
+	m_NrTilesX = (m_Width + m_TileSize - 1) / m_TileSize;
+	m_NrTilesY = (m_Height + m_TileSize - 1) / m_TileSize;
+
+	//hi-z: max depth per 8x8 block and per tile
+	m_NrBlocksX = (m_Width + blockSize - 1) / blockSize;
+	m_NrBlocksY = (m_Height + blockSize - 1) / blockSize;
+	m_pHiZBlocks = new float[m_NrBlocksX * m_NrBlocksY];
+	m_pHiZTiles = new float[m_NrTilesX * m_NrTilesY];
+
+	m_pThreadPool = new ThreadPool();
+
+	//the raster kernels are instantiated for both instruction sets, the cpu picks one for the lifetime of the renderer
+	m_UseAvx2Kernels = GetSimdLevel() >= SimdLevel::avx2;
 
 
 	std::vector<Vertex> vertices;
@@ -35,14 +156,12 @@ Renderer::Renderer(SDL_Window* pWindow) :
 
 	//load obj
 	Utils::ParseOBJ("Resources/vehicle.obj", vertices, indices);
-	m_MeshesWorld.emplace_back(vertices, indices, PrimitiveTopology::TriangleList);
+	m_MeshesWorld.emplace_back(VertexStreams{ vertices }, indices, PrimitiveTopology::TriangleList);
 
 	//load textures
-	//m_pTexture = Texture::LoadFromFile("Resources/tuktuk.png");
-	m_pTexture = Texture::LoadFromFile("resources/vehicle_diffuse.png");
-	m_pNormalMap = Texture::LoadFromFile("resources/vehicle_normal.png");
-	m_pSpecularMap = Texture::LoadFromFile("resources/vehicle_specular.png");
-	m_pGlossinessMap = Texture::LoadFromFile("resources/vehicle_gloss.png");
+	//one block compressed material texture: a fragment fetches all its maps from one block, at a sixth of the memory of 4 RGBA8 maps
+	m_pMaterial = Texture::LoadMaterialFromFiles("resources/vehicle_diffuse.png", "resources/vehicle_normal.png", "resources/vehicle_specular.png", "resources/vehicle_gloss.png",
+		m_pThreadPool, Texture::TexelLayout::tiled, Texture::MaterialFormat::compressed);
 
 
 	//Initialize Camera
@@ -61,7 +180,11 @@ Renderer::Renderer(SDL_Window* pWindow) :
 Renderer::~Renderer()
 {
 	delete[] m_pDepthBufferPixels;
-	delete m_pTexture;
+	delete[] m_pVisibilityBuffer;
+	delete[] m_pHiZBlocks;
+	delete[] m_pHiZTiles;
+	delete m_pMaterial;
+	delete m_pThreadPool;
 }
 
 void Renderer::Update(Timer* pTimer)
@@ -77,498 +200,1184 @@ void Renderer::Update(Timer* pTimer)
 }
 
 
-void Renderer::Render() const
+constexpr int Renderer::GetPermutationIndex(RasterPass rasterPass, DisplayMode displayMode, bool useAvx2, bool countFragments)
+{
+	return ((static_cast<int>(countFragments) * 2 + static_cast<int>(useAvx2)) * 4 + static_cast<int>(rasterPass)) * 2 + static_cast<int>(displayMode);
+}
+
+constexpr Renderer::RasterPermutation Renderer::GetPermutation(int permutationIdx)
+{
+	RasterPermutation permutation{};
+	permutation.countFragments = permutationIdx / 16 == 1;
+	permutation.useAvx2 = permutationIdx / 8 % 2 == 1;
+	permutation.rasterPass = static_cast<RasterPass>(permutationIdx / 2 % 4);
+	permutation.displayMode = static_cast<DisplayMode>(permutationIdx % 2);
+
+	//modes that change nothing for this pass all share one instantiation
+	if (!permutation.IsShaded()) permutation.displayMode = DisplayMode::depthBuffer;
+#if !defined(DAE_AVX2_KERNELS)
+	//never picked at runtime without the kernels
+	permutation.useAvx2 = false;
+#endif
+	return permutation;
+}
+
+void Renderer::Render()
 {
 	//clear BackGround and reset DepthBuffer
 	ClearBackground();
 	ResetDepthBuffer();
+	m_CullStats = {};
+
+	m_NrDepthTestPassed = 0;
+	m_NrShaded = 0;
+
+	//triangles of all meshes are set up and binned first, then rasterized in one go per pass
+	//triangle setups stay alive for the whole frame, their index is the id in the visibility buffer
+	//drop the buffers of the last frame before their memory goes back to the arena
+	m_VisibleIndices = ArenaVector<uint32_t>{ m_FrameArena };
+	m_TriangleSetups = ArenaVector<TriangleSetup>{ m_FrameArena };
+	m_DrawCalls = ArenaVector<DrawCall>{ m_FrameArena };
+	m_FrameArena.Reset();
+
+	size_t nrIndices{};
+	size_t maxNrIndices{};
+	for (const Mesh& mesh : m_MeshesWorld)
+	{
+		const size_t nrMeshIndices{ mesh.primitiveTopology == PrimitiveTopology::TriangleList ? mesh.indices.size() : std::max(mesh.indices.size(), size_t{ 2 }) * 3 - 6 };
+		nrIndices += nrMeshIndices;
+		maxNrIndices = std::max(maxNrIndices, nrMeshIndices);
+	}
+	m_VisibleIndices.reserve(maxNrIndices);
+	m_TriangleSetups.reserve(nrIndices / 3);
+	m_DrawCalls.reserve(m_MeshesWorld.size());
+
+	//the shading mode and normal map pick the pixel shader of the built-in material, once per frame
+	static constexpr auto submitPhongMeshTable{ []<size_t... shaderIndices>(std::index_sequence<shaderIndices...>)
+		{
+			return std::array<void (Renderer::*)(const Mesh&, const Matrix&), sizeof...(shaderIndices)>{ &Renderer::SubmitPhongMesh<static_cast<ShadingMode>(shaderIndices / 2), shaderIndices % 2 == 1>... };
+		}(std::make_index_sequence<4 * 2>{}) };
+
+	const auto submitPhongMesh{ submitPhongMeshTable[static_cast<int>(m_ShadingMode) * 2 + static_cast<int>(m_UseNormalMap)] };
 
 	// for each mesh
 	for (const auto& mesh : m_MeshesWorld)
 	{
 		const auto worldViewProjectionMatrix = mesh.worldMatrix * m_Camera.viewMatrix * m_Camera.projectionMatrix;
 
-		std::vector<Vertex_Out> vertices_ndc{};
-		std::vector<Vector2>vertices_screen{};
+		(this->*submitPhongMesh)(mesh, worldViewProjectionMatrix);
+	}
+
+	BinTriangles();
+
+	switch (m_PipelineMode)
+	{
+	case PipelineMode::forward:
+	{
+		RasterizeTiles(RasterPass::shade);
+		break;
+	}
+	case PipelineMode::depthPrepass:
+	{
+		//depth of every mesh first, then only the fragments that end up visible get interpolated and shaded
+		RasterizeTiles(RasterPass::depthOnly);
+		RasterizeTiles(RasterPass::shadeEqualDepth);
+		break;
+	}
+	case PipelineMode::visibilityBuffer:
+	{
+		RasterizeTiles(RasterPass::visibility);
+		ShadeVisibilityBuffer();
+		break;
+	}
+	}
+
+	m_FragmentStats.nrDepthTestPassed = m_NrDepthTestPassed.load();
+	m_FragmentStats.nrShaded = m_NrShaded.load();
+
+	//@END
+	//Update SDL Surface
+	SDL_UnlockSurface(m_pBackBuffer);
+	SDL_BlitSurface(m_pBackBuffer, nullptr, m_pFrontBuffer, nullptr);
+	SDL_UpdateWindowSurface(m_pWindow);
+}
+
+template<ShadingMode shadingMode, bool useNormalMap>
+void Renderer::SubmitPhongMesh(const Mesh& mesh, const Matrix& worldViewProjectionMatrix)
+{
+	using PixelShaderType = PhongPixelShader<shadingMode, useNormalMap>;
+
+	const PhongVertexShader<typename PixelShaderType::Varyings> vertexShader{ worldViewProjectionMatrix, mesh.worldMatrix, m_Camera.origin };
+	const PixelShaderType pixelShader{ m_pMaterial };
+
+	SubmitMesh(mesh, vertexShader, pixelShader);
+}
+
+template<typename VertexShaderType, PixelShader PixelShaderType>
+	requires VertexShader<VertexShaderType, typename PixelShaderType::Varyings>
+void Renderer::SubmitMesh(const Mesh& mesh, const VertexShaderType& vertexShader, const PixelShaderType& pixelShader)
+{
+	using Varyings = typename PixelShaderType::Varyings;
+
+	//the kernels for this pixel shader, permutations that never run it share the shader independent instantiations
+	static constexpr auto rasterizeTriangleTable{ []<size_t... permutationIndices>(std::index_sequence<permutationIndices...>)
+		{
+			return std::array<RasterizeTriangleFunction, sizeof...(permutationIndices)>{
+				&Renderer::RasterizeTriangle<GetPermutation(permutationIndices), std::conditional_t<GetPermutation(permutationIndices).UsesVaryings(), PixelShaderType, void>>... };
+		}(std::make_index_sequence<nrRasterPermutations>{}) };
+
+	static constexpr std::array<ShadeVisibilityBatchFunction, 2 * 2> shadeVisibilityBatchTable
+	{
+		&Renderer::ShadeVisibilityBatch<GetPermutation(GetPermutationIndex(RasterPass::shade, DisplayMode::depthBuffer, false, false)), void>,
+		&Renderer::ShadeVisibilityBatch<GetPermutation(GetPermutationIndex(RasterPass::shade, DisplayMode::finalColor, false, false)), PixelShaderType>,
+		&Renderer::ShadeVisibilityBatch<GetPermutation(GetPermutationIndex(RasterPass::shade, DisplayMode::depthBuffer, true, false)), void>,
+		&Renderer::ShadeVisibilityBatch<GetPermutation(GetPermutationIndex(RasterPass::shade, DisplayMode::finalColor, true, false)), PixelShaderType>
+	};
+
+	const uint32_t drawCallIdx{ static_cast<uint32_t>(m_DrawCalls.size()) };
+	DrawCall& drawCall{ m_DrawCalls.emplace_back() };
+	drawCall.rasterizeTriangle = rasterizeTriangleTable;
+	drawCall.shadeVisibilityBatch = shadeVisibilityBatchTable;
+	std::construct_at(reinterpret_cast<PixelShaderType*>(drawCall.pixelShader), pixelShader);
+
+	//the vertex stage writes straight into arena memory without a zero fill
+	//every position is written, the varyings only of the vertices that end up in a visible triangle
+	const uint32_t nrVertices{ static_cast<uint32_t>(mesh.vertices.GetNrVertices()) };
+	Vector4* pPositionsClip{ m_FrameArena.Allocate<Vector4>(nrVertices) };
+	Varyings* pVaryings{ m_FrameArena.Allocate<Varyings>(nrVertices) };
+
+	//the vertices of clipped polygons, vertex index nrVertices + i
+	ArenaVector<Vector4> clippedPositions{ m_FrameArena };
+	ArenaVector<Varyings> clippedVaryings{ m_FrameArena };
+
+	VertexTransformationFunction<Varyings>(mesh.vertices, vertexShader, pPositionsClip);
+
+	//triangle assembly + frustum rejection + near plane clipping
+	switch (mesh.primitiveTopology)
+	{
+	case PrimitiveTopology::TriangleList:
+	{
+		ClipTriangles<PrimitiveTopology::TriangleList>(mesh, pPositionsClip, vertexShader, clippedPositions, clippedVaryings);
+		break;
+	}
+	case PrimitiveTopology::TriangleStrip:
+	{
+		ClipTriangles<PrimitiveTopology::TriangleStrip>(mesh, pPositionsClip, vertexShader, clippedPositions, clippedVaryings);
+		break;
+	}
+	}
+
+	//perspective divide + viewport in one pass, the mesh vertices and the clipped ones end up in one array
+	const uint32_t nrClippedVertices{ static_cast<uint32_t>(clippedPositions.size()) };
+	Vector4* pPositionsNdc{ m_FrameArena.Allocate<Vector4>(nrVertices + nrClippedVertices) };
+	Vector2* pVerticesScreen{ m_FrameArena.Allocate<Vector2>(nrVertices + nrClippedVertices) };
+	VertexTransformationToScreenSpace({ pPositionsClip, nrVertices }, pPositionsNdc, pVerticesScreen);
+	VertexTransformationToScreenSpace(clippedPositions, pPositionsNdc + nrVertices, pVerticesScreen + nrVertices);
+
+	//facing, only the surviving triangles get set up
+	CullTriangles(pVerticesScreen);
+
+	//second half of the vertex stage, now that it is known which vertices are still needed
+	ComputeVisibleVaryings(mesh.vertices, vertexShader, pVaryings);
+
+	//setup records for the raster loop, binned once every mesh is submitted
+	SetupTriangles(pPositionsNdc, VertexOutputStream<Varyings>{ pVaryings, nrVertices, clippedVaryings }, pVerticesScreen, drawCallIdx);
+}
+
+template<PrimitiveTopology topology, typename VertexShaderType, ShaderVaryings Varyings>
+void Renderer::ClipTriangles(const Mesh& mesh, const Vector4* positions_clip, const VertexShaderType& vertexShader, ArenaVector<Vector4>& clippedPositions, ArenaVector<Varyings>& clippedVaryings)
+{
+	m_VisibleIndices.clear();
+
+	if (mesh.indices.size() < 3) return;
+
+	//if triangle list -> go over indices by 3, if triangle strip -> every index starts a triangle
+	const size_t nrTriangles{ topology == PrimitiveTopology::TriangleList ? mesh.indices.size() / 3 : mesh.indices.size() - 2 };
 
-		VertexTransformationFunction(mesh.vertices, vertices_ndc, worldViewProjectionMatrix, mesh.worldMatrix);
+	for (size_t triangleIdx{}; triangleIdx < nrTriangles; ++triangleIdx)
+	{
+		++m_CullStats.nrTriangles;
 
-		VertexTransformationToScreenSpace(vertices_ndc, vertices_screen);
+		//get vertex index
+		uint32_t vertexIndices[3]{};
+		if constexpr (topology == PrimitiveTopology::TriangleList)
+		{
+			vertexIndices[0] = mesh.indices[triangleIdx * 3];
+			vertexIndices[1] = mesh.indices[triangleIdx * 3 + 1];
+			vertexIndices[2] = mesh.indices[triangleIdx * 3 + 2];
+		}
+		else
+		{
+			//uneven index -> flip triangle, so the whole strip keeps one winding
+			const bool swapVertices{ triangleIdx % 2 == 1 };
+			vertexIndices[0] = mesh.indices[triangleIdx];
+			vertexIndices[1] = mesh.indices[triangleIdx + (swapVertices ? 2 : 1)];
+			vertexIndices[2] = mesh.indices[triangleIdx + (swapVertices ? 1 : 2)];
+		}
 
-		//if triangle list -> go over indices by 3 to get full triangle
-		if (mesh.primitiveTopology == PrimitiveTopology::TriangleList)
+		const uint32_t outcodes[3]
 		{
-			for (size_t vertexIndex{}; vertexIndex < mesh.indices.size(); vertexIndex += 3)
+			ComputeOutcode(positions_clip[vertexIndices[0]]),
+			ComputeOutcode(positions_clip[vertexIndices[1]]),
+			ComputeOutcode(positions_clip[vertexIndices[2]])
+		};
+
+		//all vertices outside the same plane -> the whole triangle is
+		if (outcodes[0] & outcodes[1] & outcodes[2])
+		{
+			++m_CullStats.nrFrustumCulled;
+			continue;
+		}
+
+		const uint32_t crossedPlanes{ outcodes[0] | outcodes[1] | outcodes[2] };
+
+		//common case: in front of the near plane and within the guard band, the bounding box clamp does the rest
+		if (!(crossedPlanes & clippingPlanes))
+		{
+			if (crossedPlanes & screenEdgePlanes) ++m_CullStats.nrGuardBandAccepted;
+
+			m_VisibleIndices.insert(m_VisibleIndices.end(), std::begin(vertexIndices), std::end(vertexIndices));
+			continue;
+		}
+
+		++m_CullStats.nrClipped;
+
+		//clipped against the planes this triangle actually crosses
+		Vector4 polygon[maxClippedVertices]{ positions_clip[vertexIndices[0]], positions_clip[vertexIndices[1]], positions_clip[vertexIndices[2]] };
+		Varyings polygonVaryings[maxClippedVertices]
+		{
+			vertexShader.ComputeVaryings(mesh.vertices, vertexIndices[0]),
+			vertexShader.ComputeVaryings(mesh.vertices, vertexIndices[1]),
+			vertexShader.ComputeVaryings(mesh.vertices, vertexIndices[2])
+		};
+		m_CullStats.nrVaryingsComputed += 3;
+		const int nrPolygonVertices{ ClipPolygon(polygon, polygonVaryings, 3, crossedPlanes & clippingPlanes, LerpVaryings<Varyings>) };
+
+		if (nrPolygonVertices < 3) continue;
+
+		//the polygon is convex and keeps the winding of the triangle -> fan it out
+		const uint32_t firstVertexIdx{ static_cast<uint32_t>(mesh.vertices.GetNrVertices() + clippedPositions.size()) };
+		clippedPositions.insert(clippedPositions.end(), polygon, polygon + nrPolygonVertices);
+		clippedVaryings.insert(clippedVaryings.end(), polygonVaryings, polygonVaryings + nrPolygonVertices);
+
+		for (int polygonIdx{ 1 }; polygonIdx < nrPolygonVertices - 1; ++polygonIdx)
+		{
+			m_VisibleIndices.push_back(firstVertexIdx);
+			m_VisibleIndices.push_back(firstVertexIdx + polygonIdx);
+			m_VisibleIndices.push_back(firstVertexIdx + polygonIdx + 1);
+		}
+	}
+}
+
+void Renderer::CullTriangles(const Vector2* vertices_screen)
+{
+	//compacts the visible triangles in place
+	size_t nrVisibleIndices{};
+
+	for (size_t vertexIndex{}; vertexIndex < m_VisibleIndices.size(); vertexIndex += 3)
+	{
+		//get vertex index
+		const uint32_t vertexIndex0{ m_VisibleIndices[vertexIndex] };
+		uint32_t vertexIndex1{ m_VisibleIndices[vertexIndex + 1] };
+		uint32_t vertexIndex2{ m_VisibleIndices[vertexIndex + 2] };
+
+		//signed screen area, ParseOBJ flips the winding so front faces come out positive (y points down)
+		const Vector2& v0{ vertices_screen[vertexIndex0] };
+		const Vector2& v1{ vertices_screen[vertexIndex1] };
+		const Vector2& v2{ vertices_screen[vertexIndex2] };
+		const float signedArea{ Vector2::Cross(v1 - v0, v2 - v0) };
+
+		if (signedArea == 0.f)
+		{
+			++m_CullStats.nrDegenerateCulled;
+			continue;
+		}
+
+		const bool isFrontFace{ signedArea > 0.f };
+		if (isFrontFace && m_CullMode == CullMode::front)
+		{
+			++m_CullStats.nrFrontFacesCulled;
+			continue;
+		}
+		if (!isFrontFace && m_CullMode == CullMode::back)
+		{
+			++m_CullStats.nrBackFacesCulled;
+			continue;
+		}
+
+		//setup only knows one winding, turn back faces around
+		if (!isFrontFace) std::swap(vertexIndex1, vertexIndex2);
+
+		m_VisibleIndices[nrVisibleIndices++] = vertexIndex0;
+		m_VisibleIndices[nrVisibleIndices++] = vertexIndex1;
+		m_VisibleIndices[nrVisibleIndices++] = vertexIndex2;
+	}
+
+	m_VisibleIndices.resize(nrVisibleIndices);
+}
+
+template<ShaderVaryings Varyings>
+void Renderer::SetupTriangles(const Vector4* positions_ndc, const VertexOutputStream<Varyings>& varyings, const Vector2* vertices_screen, uint32_t drawCallIdx)
+{
+	for (size_t vertexIndex{}; vertexIndex < m_VisibleIndices.size(); vertexIndex += 3)
+	{
+		const uint32_t vertexIndex0{ m_VisibleIndices[vertexIndex] };
+		const uint32_t vertexIndex1{ m_VisibleIndices[vertexIndex + 1] };
+		const uint32_t vertexIndex2{ m_VisibleIndices[vertexIndex + 2] };
+
+		//fixed point edge equations + bounding box
+		TriangleSetup triangle{};
+		if (!SetupTriangle(vertices_screen[vertexIndex0], vertices_screen[vertexIndex1], vertices_screen[vertexIndex2], triangle)) continue;
+
+		//interpolation planes, from here on the raster loop never looks at the vertices again
+		float varyings0[nrVaryingFloats<Varyings>]{};
+		float varyings1[nrVaryingFloats<Varyings>]{};
+		float varyings2[nrVaryingFloats<Varyings>]{};
+		std::memcpy(varyings0, &varyings[vertexIndex0], sizeof(Varyings));
+		std::memcpy(varyings1, &varyings[vertexIndex1], sizeof(Varyings));
+		std::memcpy(varyings2, &varyings[vertexIndex2], sizeof(Varyings));
+
+		SetupInterpolationPlanes(positions_ndc[vertexIndex0], positions_ndc[vertexIndex1], positions_ndc[vertexIndex2],
+			varyings0, varyings1, varyings2, nrVaryingFloats<Varyings>, triangle);
+		triangle.drawCallIdx = drawCallIdx;
+
+		//texture lod: uv area per pixel area, one mip level for the whole triangle
+		if constexpr (requires(const Varyings& vertexVaryings) { { vertexVaryings.uv } -> std::convertible_to<Vector2>; })
+		{
+			const Vector2 uv0{ varyings[vertexIndex0].uv };
+			const float uvArea{ std::abs(Vector2::Cross(varyings[vertexIndex1].uv - uv0, varyings[vertexIndex2].uv - uv0)) };
+			const Vector2& screen0{ vertices_screen[vertexIndex0] };
+			const float screenArea{ std::abs(Vector2::Cross(vertices_screen[vertexIndex1] - screen0, vertices_screen[vertexIndex2] - screen0)) };
+			triangle.uvLod = .5f * std::log2(uvArea / screenArea);
+		}
+
+		m_TriangleSetups.push_back(triangle);
+	}
+}
+
+void Renderer::BinTriangles()
+{
+	//counting sort on the tiles: count per tile, prefix sum, scatter, keeps submission order inside every tile
+	const uint32_t nrTiles{ static_cast<uint32_t>(m_NrTilesX * m_NrTilesY) };
+
+	//every tile the bounding box touches
+	const auto forEachTile{ [this](const TriangleSetup& triangle, const auto& function)
+		{
+			const int minTileX{ triangle.minX / m_TileSize };
+			const int minTileY{ triangle.minY / m_TileSize };
+			const int maxTileX{ (triangle.maxX - 1) / m_TileSize };
+			const int maxTileY{ (triangle.maxY - 1) / m_TileSize };
+
+			for (int tileY{ minTileY }; tileY <= maxTileY; ++tileY)
 			{
-				//get vertex index
-				uint32_t vertexIndex0 = { mesh.indices[vertexIndex] };
-				uint32_t vertexIndex1 = { mesh.indices[vertexIndex + 1] };
-				uint32_t vertexIndex2 = { mesh.indices[vertexIndex + 2] };
-
-				//get vertices
-				const Vector2 v0{ vertices_screen[vertexIndex0] };
-				const Vector2 v1{ vertices_screen[vertexIndex1] };
-				const Vector2 v2{ vertices_screen[vertexIndex2] };
-
-				//frustrum culling
-				if (Camera::IsOutsideFrustum(vertices_ndc[vertexIndex0].position)) continue;
-				if (Camera::IsOutsideFrustum(vertices_ndc[vertexIndex1].position)) continue;
-				if (Camera::IsOutsideFrustum(vertices_ndc[vertexIndex2].position)) continue;
-
-
-				//calc edges
-				const Vector2 edge01 = v1 - v0;
-				const Vector2 edge12 = v2 - v1;
-				const Vector2 edge20 = v0 - v2;
-
-				//calc triangle area
-				const float fullTriangleArea{ Vector2::Cross(v1 - v0, v2 - v0) };
-
-				const int boundingBoxpadding{ 1 };
-				// Calculate bounding box  -> add/subtract 1 -> gets rid of lines between triangles
-				int minX = static_cast<int>(std::min({ v0.x, v1.x, v2.x })) - boundingBoxpadding;
-				int minY = static_cast<int>(std::min({ v0.y, v1.y, v2.y })) - boundingBoxpadding;
-				int maxX = static_cast<int>(std::max({ v0.x, v1.x, v2.x })) + boundingBoxpadding;
-				int maxY = static_cast<int>(std::max({ v0.y, v1.y, v2.y })) + boundingBoxpadding;
-
-				// Clamp bounding box within screen bounds
-				minX = std::max(minX, 0);
-				minY = std::max(minY, 0);
-				maxX = std::min(maxX, m_Width - 1);
-				maxY = std::min(maxY, m_Height - 1);
-
-				//for each pixel
-				for (int px{ minX }; px < maxX; ++px)
+				for (int tileX{ minTileX }; tileX <= maxTileX; ++tileX)
 				{
-					for (int py{ minY }; py < maxY; ++py)
-					{
-
-						ColorRGB finalColor{ 0,0,0 };
-						const int pixelIdx{ px + py * m_Width };
-						const Vector2 pixel{ static_cast<float>(px),static_cast<float>(py) };
-
-						// Calc the vector between vertex and pixel
-						const Vector2 directionV0{ pixel - v0 };
-						const Vector2 directionV1{ pixel - v1 };
-						const Vector2 directionV2{ pixel - v2 };
-
-						// Calc the barycentric weights
-						float weightV0{ Vector2::Cross(edge12 , directionV1) };
-						float weightV1{ Vector2::Cross(edge20,directionV2) };
-						float weightV2{ Vector2::Cross(edge01,directionV0) };
-
-						//hit-test
-						if (weightV0 < 0)
-							continue;
-						if (weightV1 < 0)
-							continue;
-						if (weightV2 < 0)
-							continue;
-
-						weightV0 /= fullTriangleArea;
-						weightV1 /= fullTriangleArea;
-						weightV2 /= fullTriangleArea;
-
-
-
-						//Calculate the depth
-						const float depthV0{ (vertices_ndc[vertexIndex0].position.z) };
-						const float depthV1{ (vertices_ndc[vertexIndex1].position.z) };
-						const float depthV2{ (vertices_ndc[vertexIndex2].position.z) };
-
-						// Calculate the depth at this pixel
-						const float interpolatedDepth
-						{
-							1.0f /
-							(weightV0 * 1.0f / depthV0 +
-								weightV1 * 1.0f / depthV1 +
-								weightV2 * 1.0f / depthV2)
-						};
-
-						
-						if (m_pDepthBufferPixels[pixelIdx] < interpolatedDepth) continue;
-
-						// Save the new depth
-						m_pDepthBufferPixels[pixelIdx] = interpolatedDepth;
-
-						
-						//calculate WDepth
-						const float wDepthV0{ (vertices_ndc[vertexIndex0].position.w) };
-						const float wDepthV1{ (vertices_ndc[vertexIndex1].position.w) };
-						const float wDepthV2{ (vertices_ndc[vertexIndex2].position.w) };
-
-
-						//Update Color in Buffer
-						switch (m_displayMode)
-						{
-						case DisplayMode::finalColor:
-
-						{
-							const float interpolatedWDepth
-							{
-
-								1.f /
-								(weightV0 / wDepthV0 + weightV1 / wDepthV1 + weightV2 / wDepthV2)
-							};
-
-							Vector2 interpolatedUv
-							{
-								((vertices_ndc[vertexIndex0].uv / wDepthV0) * weightV0 +
-								(vertices_ndc[vertexIndex1].uv / wDepthV1) * weightV1 +
-								(vertices_ndc[vertexIndex2].uv / wDepthV2) * weightV2) * interpolatedWDepth
-
-							};
-							Vector3 interpolatedNormal
-							{
-									((vertices_ndc[vertexIndex0].normal / wDepthV0) * weightV0 +
-								(vertices_ndc[vertexIndex1].normal / wDepthV1) * weightV1 +
-								(vertices_ndc[vertexIndex2].normal / wDepthV2) * weightV2)* interpolatedWDepth
-							};
-
-							interpolatedNormal.Normalize();
-
-							Vector3 interpolatedTangent
-							{
-								((vertices_ndc[vertexIndex0].tangent / wDepthV0) * weightV0 +
-								(vertices_ndc[vertexIndex1].tangent / wDepthV1) * weightV1 +
-								(vertices_ndc[vertexIndex2].tangent / wDepthV2) * weightV2) * interpolatedWDepth
-
-							};
-							interpolatedTangent.Normalize();
-
-							Vector3 interpolatedViewDirection
-							{
-								((vertices_ndc[vertexIndex0].viewDirection / wDepthV0) * weightV0 +
-								(vertices_ndc[vertexIndex1].viewDirection / wDepthV1) * weightV1 +
-								(vertices_ndc[vertexIndex2].viewDirection / wDepthV2) * weightV2)* interpolatedWDepth
-							};
-							Vertex_Out pixelVertex{};
-							pixelVertex.position = Vector4{ pixel.x,pixel.y,interpolatedDepth,interpolatedWDepth };
-							pixelVertex.color = ColorRGB{ 0,0,0 };
-							pixelVertex.uv = interpolatedUv;
-							pixelVertex.normal = interpolatedNormal;
-							pixelVertex.tangent = interpolatedTangent;
-							pixelVertex.viewDirection = interpolatedViewDirection;
-
-							finalColor = PixelShading(pixelVertex);
-							break;
-						}
-
-						case DisplayMode::depthBuffer:
-						{
-							const float depthBufferColor = Remap(m_pDepthBufferPixels[px + (py * m_Width)], 0.995f, 1.0f);
-
-							finalColor = { depthBufferColor, depthBufferColor, depthBufferColor };
-							break;
-						}
-						}
-
-						finalColor.MaxToOne();
-
-						m_pBackBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBackBuffer->format,
-							static_cast<uint8_t>(finalColor.r * 255),
-							static_cast<uint8_t>(finalColor.g * 255),
-							static_cast<uint8_t>(finalColor.b * 255));
-					}
+					function(static_cast<uint32_t>(tileX + tileY * m_NrTilesX));
 				}
 			}
-		}
-		//@END
-		//Update SDL Surface
-		SDL_UnlockSurface(m_pBackBuffer);
-		SDL_BlitSurface(m_pBackBuffer, nullptr, m_pFrontBuffer, nullptr);
-		SDL_UpdateWindowSurface(m_pWindow);
+		} };
+
+	//the count of tile i goes to offset i + 1, so the prefix sum leaves the start of every bin at its own index
+	m_pTileBinOffsets = m_FrameArena.Allocate<uint32_t>(nrTiles + 1);
+	std::fill_n(m_pTileBinOffsets, nrTiles + 1, 0u);
+	for (const TriangleSetup& triangle : m_TriangleSetups)
+	{
+		forEachTile(triangle, [this](uint32_t tileIdx) { ++m_pTileBinOffsets[tileIdx + 1]; });
 	}
+	for (uint32_t tileIdx{ 1 }; tileIdx <= nrTiles; ++tileIdx)
+	{
+		m_pTileBinOffsets[tileIdx] += m_pTileBinOffsets[tileIdx - 1];
+	}
+
+	uint32_t* pBinEnds{ m_FrameArena.Allocate<uint32_t>(nrTiles) };
+	std::copy_n(m_pTileBinOffsets, nrTiles, pBinEnds);
+	m_pTileBinTriangles = m_FrameArena.Allocate<uint32_t>(m_pTileBinOffsets[nrTiles]);
+	for (uint32_t triangleIdx{}; triangleIdx < m_TriangleSetups.size(); ++triangleIdx)
+	{
+		forEachTile(m_TriangleSetups[triangleIdx], [&](uint32_t tileIdx) { m_pTileBinTriangles[pBinEnds[tileIdx]++] = triangleIdx; });
+	}
+}
+
+bool Renderer::SetupTriangle(const Vector2& v0, const Vector2& v1, const Vector2& v2, TriangleSetup& triangle) const
+{
+	//snap to the sub-pixel grid, every edge equation below is exact from here on
+	const int64_t x0{ std::llround(v0.x * subPixelOne) };
+	const int64_t y0{ std::llround(v0.y * subPixelOne) };
+	const int64_t x1{ std::llround(v1.x * subPixelOne) };
+	const int64_t y1{ std::llround(v1.y * subPixelOne) };
+	const int64_t x2{ std::llround(v2.x * subPixelOne) };
+	const int64_t y2{ std::llround(v2.y * subPixelOne) };
+
+	//calc triangle area, culling already turned every triangle front facing -> only triangles that collapse on the sub-pixel grid are dropped here
+	const int64_t fullTriangleArea{ (x1 - x0) * (y2 - y0) - (y1 - y0) * (x2 - x0) };
+	if (fullTriangleArea <= 0) return false;
+
+	// Calculate bounding box -> only pixels whose center lies inside it
+	triangle.minX = static_cast<int>((std::min({ x0, x1, x2 }) - subPixelHalf + subPixelOne - 1) >> subPixelBits);
+	triangle.minY = static_cast<int>((std::min({ y0, y1, y2 }) - subPixelHalf + subPixelOne - 1) >> subPixelBits);
+	triangle.maxX = static_cast<int>((std::max({ x0, x1, x2 }) - subPixelHalf) >> subPixelBits) + 1;
+	triangle.maxY = static_cast<int>((std::max({ y0, y1, y2 }) - subPixelHalf) >> subPixelBits) + 1;
+
+	// Clamp bounding box within screen bounds
+	triangle.minX = std::max(triangle.minX, 0);
+	triangle.minY = std::max(triangle.minY, 0);
+	triangle.maxX = std::min(triangle.maxX, m_Width);
+	triangle.maxY = std::min(triangle.maxY, m_Height);
+
+	//max is exclusive, nothing to draw
+	if (triangle.minX >= triangle.maxX || triangle.minY >= triangle.maxY) return false;
+
+	triangle.edges[0] = SetupEdgeFunction(x1, y1, x2, y2);
+	triangle.edges[1] = SetupEdgeFunction(x2, y2, x0, y0);
+	triangle.edges[2] = SetupEdgeFunction(x0, y0, x1, y1);
+	triangle.invArea = 1.f / static_cast<float>(fullTriangleArea);
+
+	return true;
 }
 
-void Renderer::RenderTriangleStrip(std::vector<Mesh>& meshes_world, std::vector<Vertex_Out>& vertices_ndc,std::vector<Vector2>&vertices_screen) const
+void Renderer::SetupInterpolationPlanes(const Vector4& position0, const Vector4& position1, const Vector4& position2,
+	const float* varyings0, const float* varyings1, const float* varyings2, int nrVaryings, TriangleSetup& triangle) const
 {
-	for (const auto& mesh : meshes_world)
+	//planes are relative to the first pixel of the bounding box, that keeps the values small and precise
+	triangle.referenceX = triangle.minX;
+	triangle.referenceY = triangle.minY;
+
+	//barycentric weights at the reference pixel and how much they change per pixel
+	double weights[3]{};
+	double weightStepsX[3]{};
+	double weightStepsY[3]{};
+	for (int edgeIdx{}; edgeIdx < 3; ++edgeIdx)
 	{
-		//if triangle strip -> loop over indices by 1
-		if (mesh.primitiveTopology == PrimitiveTopology::TriangleStrip)
+		const EdgeFunction& edge{ triangle.edges[edgeIdx] };
+		weights[edgeIdx] = static_cast<double>(edge.Evaluate(triangle.referenceX, triangle.referenceY)) * triangle.invArea;
+		weightStepsX[edgeIdx] = static_cast<double>(edge.stepX) * triangle.invArea;
+		weightStepsY[edgeIdx] = static_cast<double>(edge.stepY) * triangle.invArea;
+	}
+
+	const auto setupPlane = [&](double value0, double value1, double value2)
 		{
-			for (int vertexIndex{}; vertexIndex < mesh.indices.size() - 2; ++vertexIndex)
+			InterpolationPlane plane{};
+			plane.ddx = static_cast<float>(value0 * weightStepsX[0] + value1 * weightStepsX[1] + value2 * weightStepsX[2]);
+			plane.ddy = static_cast<float>(value0 * weightStepsY[0] + value1 * weightStepsY[1] + value2 * weightStepsY[2]);
+			plane.reference = static_cast<float>(value0 * weights[0] + value1 * weights[1] + value2 * weights[2]);
+			return plane;
+		};
+
+	//ndc depth is linear in screen space
+	triangle.depth = setupPlane(position0.z, position1.z, position2.z);
+	triangle.minDepth = std::min({ position0.z, position1.z, position2.z });
+	triangle.maxDepth = std::max({ position0.z, position1.z, position2.z });
+
+	//everything else is interpolated perspective correct: value / w is linear in screen space
+	const double invWDepth0{ 1.0 / position0.w };
+	const double invWDepth1{ 1.0 / position1.w };
+	const double invWDepth2{ 1.0 / position2.w };
+	triangle.invWDepth = setupPlane(invWDepth0, invWDepth1, invWDepth2);
+
+	for (int varyingIdx{}; varyingIdx < nrVaryings; ++varyingIdx)
+	{
+		triangle.varyings[varyingIdx] = setupPlane(varyings0[varyingIdx] * invWDepth0, varyings1[varyingIdx] * invWDepth1, varyings2[varyingIdx] * invWDepth2);
+	}
+}
+
+void Renderer::RasterizeTiles(RasterPass rasterPass)
+{
+	//every permutation is its own instantiation, the draw call of each triangle holds the ones for its pixel shader
+	const int permutationIdx{ GetPermutationIndex(rasterPass, m_displayMode, m_UseAvx2Kernels, m_CountFragments) };
+
+	//every tile belongs to exactly one thread -> depth/color writes never race
+	m_pThreadPool->ParallelFor(static_cast<uint32_t>(m_NrTilesX * m_NrTilesY), [&](uint32_t tileIdx)
+		{
+			RasterizeTile(tileIdx, permutationIdx);
+		});
+}
+
+void Renderer::ShadeVisibilityBuffer()
+{
+	//deferred shading: every visible pixel is shaded exactly once, rows are independent
+	m_pThreadPool->ParallelFor(static_cast<uint32_t>(m_Height), [&](uint32_t py)
+		{
+			ShadeVisibilityRow(static_cast<int>(py));
+		});
+}
+
+void Renderer::RasterizeTile(uint32_t tileIdx, int permutationIdx) const
+{
+	const int tileMinX{ static_cast<int>(tileIdx % m_NrTilesX) * m_TileSize };
+	const int tileMinY{ static_cast<int>(tileIdx / m_NrTilesX) * m_TileSize };
+	const int tileMaxX{ std::min(tileMinX + m_TileSize, m_Width) };
+	const int tileMaxY{ std::min(tileMinY + m_TileSize, m_Height) };
+
+	const int tileBlockMinX{ tileMinX / blockSize };
+	const int tileBlockMinY{ tileMinY / blockSize };
+	const int tileBlockMaxX{ (tileMaxX + blockSize - 1) / blockSize };
+	const int tileBlockMaxY{ (tileMaxY + blockSize - 1) / blockSize };
+
+	//stays zero unless the permutation counts fragments
+	FragmentStats tileStats{};
+
+	for (const uint32_t triangleIdx : GetTileBin(tileIdx))
+	{
+		const TriangleSetup& triangle{ m_TriangleSetups[triangleIdx] };
+
+		//hi-z: the whole triangle is behind everything in this tile
+		if (triangle.minDepth - hiZSlack > m_pHiZTiles[tileIdx]) continue;
+
+		//only the part of the bounding box inside this tile
+		const int minX{ std::max(triangle.minX, tileMinX) };
+		const int minY{ std::max(triangle.minY, tileMinY) };
+		const int maxX{ std::min(triangle.maxX, tileMaxX) };
+		const int maxY{ std::min(triangle.maxY, tileMaxY) };
+
+		const DrawCall& drawCall{ m_DrawCalls[triangle.drawCallIdx] };
+		if (!(this->*drawCall.rasterizeTriangle[permutationIdx])(triangle, minX, minY, maxX, maxY, drawCall.pixelShader, tileStats)) continue;
+
+		//some block got closer, the tile max is the max of its blocks
+		float tileMaxDepth{};
+		for (int blockY{ tileBlockMinY }; blockY < tileBlockMaxY; ++blockY)
+		{
+			for (int blockX{ tileBlockMinX }; blockX < tileBlockMaxX; ++blockX)
 			{
-				// bool top swap vertices -> uneven index -> flip triangle
-				bool swapVertices = vertexIndex % 2;
-
-				uint32_t vertexIndex0 = { mesh.indices[vertexIndex] };
-				uint32_t vertexIndex1 = { mesh.indices[vertexIndex + 1 * !swapVertices + 2 * swapVertices] };
-				uint32_t vertexIndex2 = { mesh.indices[vertexIndex + 2 * !swapVertices + 1 * swapVertices] };
-
-				//frustrum clipping
-				if (Camera::IsOutsideFrustum(vertices_ndc[vertexIndex0].position)) continue;
-				if (Camera::IsOutsideFrustum(vertices_ndc[vertexIndex1].position)) continue;
-				if (Camera::IsOutsideFrustum(vertices_ndc[vertexIndex2].position)) continue;
-
-				//get vertices
-				const Vector2 v0{ vertices_screen[vertexIndex0] };
-				const Vector2 v1{ vertices_screen[vertexIndex1] };
-				const Vector2 v2{ vertices_screen[vertexIndex2] };
-
-				//calc edges
-
-				const Vector2 edge01 = v1 - v0;
-				const Vector2 edge12 = v2 - v1;
-				const Vector2 edge20 = v0 - v2;
-
-				//calc triangle area
-				const float fullTriangleArea{ Vector2::Cross(v1 - v0, v2 - v0) };
-
-				const int boundingBoxpadding{ 1 };
-				// Calculate bounding box of the triangle -> add/subtract 1 -> gets rid of lines between triangles
-				int minX = static_cast<int>(std::min({ v0.x, v1.x, v2.x })) - boundingBoxpadding;
-				int minY = static_cast<int>(std::min({ v0.y, v1.y, v2.y })) - boundingBoxpadding;
-				int maxX = static_cast<int>(std::max({ v0.x, v1.x, v2.x })) + boundingBoxpadding;
-				int maxY = static_cast<int>(std::max({ v0.y, v1.y, v2.y })) + boundingBoxpadding;
-
-				// Clamp bounding box within screen bounds
-				minX = std::max(minX, 0);
-				minY = std::max(minY, 0);
-				maxX = std::min(maxX, m_Width - 1);
-				maxY = std::min(maxY, m_Height - 1);
-
-				for (int px{ minX }; px < maxX; ++px)
-				{
-					for (int py{ minY }; py < maxY; ++py)
-					{
+				tileMaxDepth = std::max(tileMaxDepth, m_pHiZBlocks[blockX + blockY * m_NrBlocksX]);
+			}
+		}
+		m_pHiZTiles[tileIdx] = tileMaxDepth;
+	}
 
-						ColorRGB finalColor{ 0,0,0 };
-						const int pixelIdx{ px + py * m_Width };
-						const Vector2 pixel{ static_cast<float>(px),static_cast<float>(py) };
-
-						// Calculate the vector between vertex and the point
-						const Vector2 directionV0{ pixel - v0 };
-						const Vector2 directionV1{ pixel - v1 };
-						const Vector2 directionV2{ pixel - v2 };
-
-						// Calculate the barycentric weights
-						float weightV0{ Vector2::Cross(edge12 , directionV1) };
-						float weightV1{ Vector2::Cross(edge20,directionV2) };
-						float weightV2{ Vector2::Cross(edge01,directionV0) };
-
-						//hit-test
-						if (weightV0 < 0)
-							continue;
-						if (weightV1 < 0)
-							continue;
-						if (weightV2 < 0)
-							continue;
-
-						weightV0 /= fullTriangleArea;
-						weightV1 /= fullTriangleArea;
-						weightV2 /= fullTriangleArea;
-
-
-
-						//Calculate the depth
-						const float depthV0{ (vertices_ndc[vertexIndex0].position.z) };
-						const float depthV1{ (vertices_ndc[vertexIndex1].position.z) };
-						const float depthV2{ (vertices_ndc[vertexIndex2].position.z) };
-
-						// Calculate the depth at this pixel
-						const float interpolatedDepth
-						{
-							1.0f /
-							(weightV0 * 1.0f / depthV0 +
-								weightV1 * 1.0f / depthV1 +
-								weightV2 * 1.0f / depthV2)
-						};
-
-						// If this pixel hit is further away then a previous pixel hit, continue to the next pixel
-						if (m_pDepthBufferPixels[pixelIdx] < interpolatedDepth) continue;
-
-						// Save the new depth
-						m_pDepthBufferPixels[pixelIdx] = interpolatedDepth;
-
-						//calculate WDepth
-						const float wDepthV0{ (vertices_ndc[vertexIndex0].position.w) };
-						const float wDepthV1{ (vertices_ndc[vertexIndex1].position.w) };
-						const float wDepthV2{ (vertices_ndc[vertexIndex2].position.w) };
-
-
-						//Update Color in Buffer
-						switch (m_displayMode)
-						{
-						case DisplayMode::finalColor:
-
-						{
-							const float interpolatedWDepth
-							{
-
-								1.f /
-								(weightV0 / wDepthV0 + weightV1 / wDepthV1 + weightV2 / wDepthV2)
-							};
-
-							Vector2 interpolatedUv
-							{
-								((vertices_ndc[vertexIndex0].uv / wDepthV0) * weightV0 +
-								(vertices_ndc[vertexIndex1].uv / wDepthV1) * weightV1 +
-								(vertices_ndc[vertexIndex2].uv / wDepthV2) * weightV2) * interpolatedWDepth
-
-							};
-							//clamp uv x and y to [0,1]
-							interpolatedUv.x = std::clamp(interpolatedUv.x, 0.0f, 1.f);
-							interpolatedUv.y = std::clamp(interpolatedUv.y, 0.f, 1.f);
-
-							finalColor = m_pTexture->Sample(interpolatedUv);
-							break;
-						}
-						case DisplayMode::depthBuffer:
-						{
-							constexpr float minValue = 0.8f;
-							constexpr float maxValue = 1.f;
-
-							// Remap the value to the range [0, 1]
-							float remappedValue = (interpolatedDepth - minValue) / (maxValue - minValue);
-							remappedValue = std::clamp(remappedValue, 0.f, 1.f);
-
-							finalColor = ColorRGB{ remappedValue, remappedValue, remappedValue };
-							break;
-						}
-						}
-
-						finalColor.MaxToOne();
-
-						m_pBackBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBackBuffer->format,
-							static_cast<uint8_t>(finalColor.r * 255),
-							static_cast<uint8_t>(finalColor.g * 255),
-							static_cast<uint8_t>(finalColor.b * 255));
-					}
-				}
+	//one add per tile, the workers don't share a cache line in the raster loop
+	if (tileStats.nrDepthTestPassed) m_NrDepthTestPassed.fetch_add(tileStats.nrDepthTestPassed, std::memory_order_relaxed);
+	if (tileStats.nrShaded) m_NrShaded.fetch_add(tileStats.nrShaded, std::memory_order_relaxed);
+}
+
+std::span<const uint32_t> Renderer::GetTileBin(uint32_t tileIdx) const
+{
+	return { m_pTileBinTriangles + m_pTileBinOffsets[tileIdx], m_pTileBinTriangles + m_pTileBinOffsets[tileIdx + 1] };
+}
+
+void Renderer::ShadeVisibilityRow(int py) const
+{
+	const int rowIdx{ py * m_Width };
+	const int shadeIdx{ static_cast<int>(m_UseAvx2Kernels) * 2 + static_cast<int>(m_displayMode) };
+	uint64_t nrShaded{};
+
+	//8 pixels at a time so the shading sees the same batches as the forward path
+	for (int px{}; px < m_Width; px += blockSize)
+	{
+		const int nrPixels{ std::min(m_Width - px, blockSize) };
+		const uint32_t* pTriangleIndices{ m_pVisibilityBuffer + rowIdx + px };
+
+		uint32_t laneMask{};
+		for (int lane{}; lane < nrPixels; ++lane)
+		{
+			if (pTriangleIndices[lane] != invalidTriangleIdx) laneMask |= 1u << lane;
+		}
+		nrShaded += std::popcount(laneMask);
+
+		//lanes of the same draw call are shaded together, usually the whole batch
+		while (laneMask)
+		{
+			const uint32_t drawCallIdx{ m_TriangleSetups[pTriangleIndices[std::countr_zero(laneMask)]].drawCallIdx };
+
+			uint32_t drawCallMask{};
+			for (uint32_t lanes{ laneMask }; lanes; lanes &= lanes - 1)
+			{
+				const int lane{ std::countr_zero(lanes) };
+				if (m_TriangleSetups[pTriangleIndices[lane]].drawCallIdx == drawCallIdx) drawCallMask |= 1u << lane;
 			}
+			laneMask &= ~drawCallMask;
+
+			const DrawCall& drawCall{ m_DrawCalls[drawCallIdx] };
+			(this->*drawCall.shadeVisibilityBatch[shadeIdx])(px, py, drawCallMask, drawCall.pixelShader);
 		}
 	}
+
+	//one add per row
+	if (m_CountFragments) m_NrShaded.fetch_add(nrShaded, std::memory_order_relaxed);
 }
 
+template<Renderer::RasterPermutation permutation, typename PixelShaderType>
+bool Renderer::RasterizeTriangle(const TriangleSetup& triangle, int minX, int minY, int maxX, int maxY, const void* pPixelShader, FragmentStats& fragmentStats) const
+{
+	switch (m_RasterMode)
+	{
+	case RasterMode::blocks:
+		return RasterizeTriangleBlocks<permutation>(triangle, minX, minY, maxX, maxY, GetPixelShader<PixelShaderType>(pPixelShader), fragmentStats);
+	case RasterMode::scanline:
+		return RasterizeTriangleSpans<permutation>(triangle, minX, minY, maxX, maxY, GetPixelShader<PixelShaderType>(pPixelShader), fragmentStats);
+	}
+	return false;
+}
 
-void Renderer::VertexTransformationFunction(const std::vector<Vertex>& vertices_in, std::vector<Vertex>& vertices_out) const
+template<Renderer::RasterPermutation permutation, typename PixelShaderType>
+bool Renderer::RasterizeTriangleBlocks(const TriangleSetup& triangle, int minX, int minY, int maxX, int maxY, const PixelShaderType* pPixelShader, FragmentStats& fragmentStats) const
 {
-	//Todo > W1 Projection Stage
+	bool hiZUpdated{ false };
 
-	//Convert to NDC > SCREEN space
-	vertices_out.resize(vertices_in.size());
-	for (size_t i{}; i < vertices_in.size(); ++i)
+	//depth range of the plane over a block, relative to its first pixel
+	const InterpolationPlane& depth{ triangle.depth };
+	const float blockMinDepthOffset{ std::min(depth.ddx, 0.f) * (blockSize - 1) + std::min(depth.ddy, 0.f) * (blockSize - 1) };
+
+	//tiles are a multiple of the block size, so blocks never straddle two tiles
+	const int firstBlockX{ minX & ~(blockSize - 1) };
+	const int firstBlockY{ minY & ~(blockSize - 1) };
+
+	//for each block
+	for (int blockY{ firstBlockY }; blockY < maxY; blockY += blockSize)
 	{
-		//Transform them with a VIEW Matrix (inverse ONB)
-		vertices_out[i].position = m_Camera.viewMatrix.TransformPoint({ vertices_in[i].position, 1.0f });
-		vertices_out[i].color = vertices_in[i].color;
+		for (int blockX{ firstBlockX }; blockX < maxX; blockX += blockSize)
+		{
+			//edge values at the first pixel of the block
+			const int64_t blockWeights[3]
+			{
+				triangle.edges[0].Evaluate(blockX, blockY),
+				triangle.edges[1].Evaluate(blockX, blockY),
+				triangle.edges[2].Evaluate(blockX, blockY)
+			};
+
+			const uint64_t coverage{ ComputeBlockCoverage<permutation.useAvx2>(triangle, blockX, blockY, blockWeights, minX, minY, maxX, maxY) };
+			if (!coverage) continue;
+
+			//hi-z: the triangle is behind everything already in this block
+			float& hiZ{ m_pHiZBlocks[blockX / blockSize + blockY / blockSize * m_NrBlocksX] };
+			const float blockDepth{ depth.reference + depth.ddx * static_cast<float>(blockX - triangle.referenceX) + depth.ddy * static_cast<float>(blockY - triangle.referenceY) };
+			const float blockMinDepth{ std::max(blockDepth + blockMinDepthOffset, triangle.minDepth) };
+			if (blockMinDepth - hiZSlack > hiZ) continue;
 
-		//Perspective Divide
-		vertices_out[i].position.x /= vertices_out[i].position.z;
-		vertices_out[i].position.y /= vertices_out[i].position.z;
+			RasterizeBlock<permutation>(triangle, blockX, blockY, coverage, pPixelShader, fragmentStats);
 
+			if (coverage == ~uint64_t{}) hiZUpdated |= LowerBlockHiZ(triangle, blockX, blockY);
+		}
+	}
+
+	return hiZUpdated;
+}
+
+bool Renderer::LowerBlockHiZ(const TriangleSetup& triangle, int blockX, int blockY) const
+{
+	//every pixel now holds at most the triangle depth, whose max over the block sits in a corner of the plane
+	const InterpolationPlane& depth{ triangle.depth };
+	const float blockDepth{ depth.reference + depth.ddx * static_cast<float>(blockX - triangle.referenceX) + depth.ddy * static_cast<float>(blockY - triangle.referenceY) };
+	const float blockMaxDepthOffset{ std::max(depth.ddx, 0.f) * (blockSize - 1) + std::max(depth.ddy, 0.f) * (blockSize - 1) };
+	const float blockMaxDepth{ std::min(blockDepth + blockMaxDepthOffset, triangle.maxDepth) + hiZSlack };
+
+	float& hiZ{ m_pHiZBlocks[blockX / blockSize + blockY / blockSize * m_NrBlocksX] };
+	if (blockMaxDepth >= hiZ) return false;
+	hiZ = blockMaxDepth;
+	return true;
+}
+
+template<Renderer::RasterPermutation permutation, typename PixelShaderType>
+bool Renderer::RasterizeTriangleSpans(const TriangleSetup& triangle, int minX, int minY, int maxX, int maxY, const PixelShaderType* pPixelShader, FragmentStats& fragmentStats) const
+{
+	bool hiZUpdated{ false };
+
+	//overlap of the spans of the rows so far in the current 8-row band of blocks, empty until a band starts
+	//the blocks inside it once all 8 rows are walked were fully covered
+	int64_t bandStart{};
+	int64_t bandEnd{};
+
+	//edge values at the first pixel of the first row
+	int64_t rowWeights[3]
+	{
+		triangle.edges[0].Evaluate(minX, minY),
+		triangle.edges[1].Evaluate(minX, minY),
+		triangle.edges[2].Evaluate(minX, minY)
+	};
+
+	for (int py{ minY }; py < maxY; ++py)
+	{
+		//exact x-extent of this row: every edge bounds the span from one side
+		int64_t spanStart{ minX };
+		int64_t spanEnd{ maxX };
+
+		for (int edgeIdx{}; edgeIdx < 3; ++edgeIdx)
+		{
+			const int64_t weight{ rowWeights[edgeIdx] };
+			const int64_t stepX{ triangle.edges[edgeIdx].stepX };
+
+			if (stepX > 0)
+			{
+				//weight + stepX * n >= 0 from n = ceil(-weight / stepX) on
+				if (weight < 0) spanStart = std::max(spanStart, minX + (-weight + stepX - 1) / stepX);
+			}
+			else if (stepX < 0)
+			{
+				//weight + stepX * n >= 0 up to n = floor(weight / -stepX)
+				spanEnd = weight < 0 ? minX : std::min(spanEnd, minX + weight / -stepX + 1);
+			}
+			else if (weight < 0)
+			{
+				//parallel to the row and outside
+				spanEnd = minX;
+			}
+		}
+
+		//walk the span left to right in 8-wide batches, so the buffers are written as one contiguous stream
+		for (int64_t px{ spanStart }; px < spanEnd; px += blockSize)
+		{
+			const int nrPixels{ static_cast<int>(std::min(spanEnd - px, int64_t{ blockSize })) };
+			RasterizeRow<permutation>(triangle, static_cast<int>(px), py, (1u << nrPixels) - 1, pPixelShader, fragmentStats);
+		}
+
+		const int bandRow{ py % blockSize };
+		bandStart = bandRow == 0 ? spanStart : std::max(bandStart, spanStart);
+		bandEnd = bandRow == 0 ? spanEnd : std::min(bandEnd, spanEnd);
+		if (bandRow == blockSize - 1)
+		{
+			//tiles are a multiple of the block size, so these blocks are in this tile
+			for (int64_t blockX{ (bandStart + blockSize - 1) & ~int64_t{ blockSize - 1 } }; blockX + blockSize <= bandEnd; blockX += blockSize)
+			{
+				hiZUpdated |= LowerBlockHiZ(triangle, static_cast<int>(blockX), py - (blockSize - 1));
+			}
+		}
+
+		rowWeights[0] += triangle.edges[0].stepY;
+		rowWeights[1] += triangle.edges[1].stepY;
+		rowWeights[2] += triangle.edges[2].stepY;
 	}
+
+	return hiZUpdated;
 }
 
-void Renderer::VertexTransformationFunction(const std::vector<Vertex>& vertices_in, std::vector<Vertex_Out>& vertices_out, const Matrix& worldViewProjectionMatrix, const Matrix& meshWorldMatrix) const
+template<bool useAvx2>
+uint64_t Renderer::ComputeBlockCoverage(const TriangleSetup& triangle, int blockX, int blockY, const int64_t blockWeights[3], int minX, int minY, int maxX, int maxY) const
 {
-	vertices_out.resize(vertices_in.size());
+	//bit (x + y * 8) is set for every pixel of the block inside [min, max)
+	const int firstColumn{ std::max(minX - blockX, 0) };
+	const int lastColumn{ std::min(maxX - blockX, blockSize) };
+	const int firstRow{ std::max(minY - blockY, 0) };
+	const int lastRow{ std::min(maxY - blockY, blockSize) };
 
-	for (size_t i{}; i < vertices_in.size(); ++i)
+	const uint64_t rowMask{ ((uint64_t{ 1 } << lastColumn) - 1) & ~((uint64_t{ 1 } << firstColumn) - 1) };
+
+	uint64_t coverage{};
+	for (int row{ firstRow }; row < lastRow; ++row)
+	{
+		coverage |= rowMask << (row * blockSize);
+	}
+
+	for (int edgeIdx{}; edgeIdx < 3; ++edgeIdx)
 	{
-		// Transform with VIEW matrix (inverse ONB)
-		vertices_out[i].position = worldViewProjectionMatrix.TransformPoint({ vertices_in[i].position, 1.0f });
-		vertices_out[i].normal = meshWorldMatrix.TransformVector(vertices_in[i].normal);
-		vertices_out[i].tangent = meshWorldMatrix.TransformVector(vertices_in[i].tangent);
+		const EdgeFunction& edge{ triangle.edges[edgeIdx] };
 
-		vertices_out[i].uv = vertices_in[i].uv;
+		//an edge equation is linear, so its extremes over the block sit in the corners
+		const int64_t cornerMin{ blockWeights[edgeIdx] + std::min(edge.stepX, int64_t{}) * (blockSize - 1) + std::min(edge.stepY, int64_t{}) * (blockSize - 1) };
+		const int64_t cornerMax{ blockWeights[edgeIdx] + std::max(edge.stepX, int64_t{}) * (blockSize - 1) + std::max(edge.stepY, int64_t{}) * (blockSize - 1) };
 
-		// Apply Perspective Divide
-		vertices_out[i].position.x /= vertices_out[i].position.w;
-		vertices_out[i].position.y /= vertices_out[i].position.w;
-		vertices_out[i].position.z /= vertices_out[i].position.w;
+		//trivial reject: the whole block is outside this edge
+		if (cornerMax < 0) return 0;
 
+		//trivial accept: the whole block is inside this edge, no need to test its pixels
+		if (cornerMin >= 0) continue;
+
+		//partial: test the rows still left against this edge only
+		uint64_t edgeCoverage{};
+		int64_t rowWeight{ blockWeights[edgeIdx] + edge.stepY * firstRow };
+#if defined(DAE_AVX2_KERNELS)
+		if constexpr (useAvx2) edgeCoverage = ComputeEdgeCoverageAvx2(edge, rowWeight, firstRow, lastRow);
+#endif
+		if constexpr (!useAvx2)
+		{
+			for (int row{ firstRow }; row < lastRow; ++row, rowWeight += edge.stepY)
+			{
+				int64_t weight{ rowWeight + edge.stepX * firstColumn };
+				for (int column{ firstColumn }; column < lastColumn; ++column, weight += edge.stepX)
+				{
+					edgeCoverage |= static_cast<uint64_t>(weight >= 0) << (column + row * blockSize);
+				}
+			}
+		}
+
+		coverage &= edgeCoverage;
+		if (!coverage) return 0;
 	}
+
+	return coverage;
 }
 
-void Renderer::VertexTransformationToScreenSpace(const std::vector<Vertex_Out>& vertices_in,
-	std::vector<Vector2>& vertex_out) const
+template<Renderer::RasterPermutation permutation, typename PixelShaderType>
+void Renderer::RasterizeBlock(const TriangleSetup& triangle, int blockX, int blockY, uint64_t coverage, const PixelShaderType* pPixelShader, FragmentStats& fragmentStats) const
 {
-	vertex_out.reserve(vertices_in.size());
-	for (const Vertex_Out& ndcVertex : vertices_in)
+	//a block row is exactly one 8-wide batch
+	for (int row{}; row < blockSize; ++row)
 	{
-		vertex_out.emplace_back(
-			m_Width * ((ndcVertex.position.x + 1) / 2.0f),
-			m_Height * ((1.0f - ndcVertex.position.y) / 2.0f)
-		);
+		const uint32_t rowCoverage{ static_cast<uint32_t>(coverage >> (row * blockSize)) & 0xFF };
+		if (rowCoverage)
+		{
+			RasterizeRow<permutation>(triangle, blockX, blockY + row, rowCoverage, pPixelShader, fragmentStats);
+		}
 	}
 }
 
-ColorRGB Renderer::PixelShading( Vertex_Out& v) const
+template<Renderer::RasterPermutation permutation, typename PixelShaderType>
+void Renderer::RasterizeRow(const TriangleSetup& triangle, int px, int py, uint32_t rowCoverage, const PixelShaderType* pPixelShader, FragmentStats& fragmentStats) const
+{
+	if constexpr (permutation.useAvx2) RasterizeRowAvx2<permutation>(triangle, px, py, rowCoverage, pPixelShader, fragmentStats);
+	else RasterizeRowScalar<permutation>(triangle, px, py, rowCoverage, pPixelShader, fragmentStats);
+}
+
+#if defined(DAE_AVX2_KERNELS)
+template<Renderer::RasterPermutation permutation, typename PixelShaderType>
+DAE_TARGET_AVX2 void Renderer::RasterizeRowAvx2(const TriangleSetup& triangle, int px, int py, uint32_t rowCoverage, const PixelShaderType* pPixelShader, FragmentStats& fragmentStats) const
 {
-	Vector3 lightDirection{ .557f,-.557f,.557f };
+	const int pixelIdx{ px + py * m_Width };
+
+	//offset of the first lane from the reference pixel of the planes
+	const float offsetX{ static_cast<float>(px - triangle.referenceX) };
+	const float offsetY{ static_cast<float>(py - triangle.referenceY) };
+	const __m256 lanes{ _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f) };
 
-	lightDirection.Normalize();
-	constexpr float lightIntensity{ 2.f };
-	constexpr float specularShininess{ 25.f };
+	//plane value at all 8 pixels: one FMA per attribute
+	const auto interpolate = [&](const InterpolationPlane& plane) DAE_TARGET_AVX2
+		{
+			const float rowValue{ plane.reference + plane.ddx * offsetX + plane.ddy * offsetY };
+			return MulAdd(lanes, _mm256_set1_ps(plane.ddx), _mm256_set1_ps(rowValue));
+		};
 
-	if (m_UseNormalMap)
+	// Calculate the depth at these pixels
+	const __m256 interpolatedDepth{ interpolate(triangle.depth) };
+
+	//lanes outside the triangle are never loaded or stored, the block can stick out of the screen
+	const __m256i laneBits{ _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128) };
+	const __m256i coverageMask{ _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(static_cast<int>(rowCoverage)), laneBits), laneBits) };
+
+	//depth test: keep the pixel unless the depth buffer is closer
+	//after a depth pre-pass only the exact winner is left, the depth is bit-identical because the math is
+	const __m256 bufferDepth{ _mm256_maskload_ps(m_pDepthBufferPixels + pixelIdx, coverageMask) };
+	const __m256 depthTest{ permutation.rasterPass == RasterPass::shadeEqualDepth ?
+		_mm256_cmp_ps(bufferDepth, interpolatedDepth, _CMP_EQ_OQ) :
+		_mm256_cmp_ps(bufferDepth, interpolatedDepth, _CMP_NLT_UQ) };
+	const __m256 depthPass{ _mm256_and_ps(_mm256_castsi256_ps(coverageMask), depthTest) };
+
+	const uint32_t passMask{ static_cast<uint32_t>(_mm256_movemask_ps(depthPass)) };
+	if (!passMask) return;
+
+	if constexpr (permutation.rasterPass != RasterPass::shadeEqualDepth)
+	{
+		// Save the new depth
+		_mm256_maskstore_ps(m_pDepthBufferPixels + pixelIdx, _mm256_castps_si256(depthPass), interpolatedDepth);
+	}
+
+	if constexpr (permutation.countFragments) CountFragments<permutation>(passMask, fragmentStats);
+
+	//visibility buffer: only remember who won, attributes are interpolated once in the shading pass
+	if constexpr (permutation.rasterPass == RasterPass::visibility)
 	{
-		const Vector3 biNormal = Vector3::Cross(v.normal, v.tangent);
-		const Matrix tangentSpaceAxis = { v.tangent, biNormal, v.normal, Vector3::Zero };
+		const int triangleIdx{ static_cast<int>(&triangle - m_TriangleSetups.data()) };
+		_mm256_maskstore_epi32(reinterpret_cast<int*>(m_pVisibilityBuffer + pixelIdx), _mm256_castps_si256(depthPass), _mm256_set1_epi32(triangleIdx));
+	}
 
-		const ColorRGB normalColor = m_pNormalMap->Sample(v.uv);
-		Vector3 sampledNormal = { normalColor.r, normalColor.g, normalColor.b };
-		sampledNormal = 2.f * sampledNormal - Vector3{ 1.f, 1.f, 1.f };
+	if constexpr (permutation.IsShaded())
+	{
+		PixelBatch batch{};
+		_mm256_store_ps(batch.depth, interpolatedDepth);
 
-		sampledNormal = tangentSpaceAxis.TransformVector(sampledNormal);
+		if constexpr (permutation.UsesVaryings())
+		{
+			//the only reciprocal per pixel, every attribute plane is pre-divided by w
+			const __m256 interpolatedWDepth{ _mm256_div_ps(_mm256_set1_ps(1.f), interpolate(triangle.invWDepth)) };
+			_mm256_store_ps(batch.wDepth, interpolatedWDepth);
+			_mm256_store_ps(batch.uvLods, _mm256_set1_ps(triangle.uvLod));
 
-		v.normal = sampledNormal.Normalized();
+			//exactly the varyings the pixel shader declares, the trip count is a compile time constant
+			for (int varyingIdx{}; varyingIdx < nrVaryingFloats<typename PixelShaderType::Varyings>; ++varyingIdx)
+			{
+				_mm256_store_ps(batch.varyings[varyingIdx], _mm256_mul_ps(interpolate(triangle.varyings[varyingIdx]), interpolatedWDepth));
+			}
+		}
+
+		ShadeRow<permutation>(px, py, passMask, batch, pPixelShader);
 	}
+}
+#endif
 
+template<Renderer::RasterPermutation permutation>
+void Renderer::CountFragments(uint32_t passMask, FragmentStats& fragmentStats)
+{
+	//the equal depth pass only shades what the depth-only pass already counted
+	if constexpr (permutation.rasterPass != RasterPass::shadeEqualDepth) fragmentStats.nrDepthTestPassed += std::popcount(passMask);
+	if constexpr (permutation.IsShaded()) fragmentStats.nrShaded += std::popcount(passMask);
+}
 
-	// OBSERVED AREA
-	float ObservedArea{ Vector3::Dot(v.normal,  -lightDirection) };
-	ObservedArea = std::max(ObservedArea, 0.f);
+template<Renderer::RasterPermutation permutation, typename PixelShaderType>
+void Renderer::RasterizeRowScalar(const TriangleSetup& triangle, int px, int py, uint32_t rowCoverage, const PixelShaderType* pPixelShader, FragmentStats& fragmentStats) const
+{
+	const int pixelIdx{ px + py * m_Width };
 
-	const ColorRGB observedAreaRGB{ ObservedArea ,ObservedArea ,ObservedArea };
+	PixelBatch batch{};
+	uint32_t passMask{};
 
-	// DIFFUSE
-	const ColorRGB TextureColor{ m_pTexture->Sample(v.uv) };
+	//scalar fallback, does the exact same math as the 8-wide kernel one lane at a time
+	for (uint32_t laneCoverage{ rowCoverage }; laneCoverage; laneCoverage &= laneCoverage - 1)
+	{
+		const int lane{ std::countr_zero(laneCoverage) };
 
-	// SPECULAR
-	const Vector3 reflect{ Vector3::Reflect(-lightDirection, v.normal) };
-	float cosAlpha{ Vector3::Dot(reflect, v.viewDirection) };
-	cosAlpha = std::max(0.f, cosAlpha);
+		// Calculate the depth at this pixel
+		const float rowDepth{ triangle.depth.reference + triangle.depth.ddx * static_cast<float>(px - triangle.referenceX) + triangle.depth.ddy * static_cast<float>(py - triangle.referenceY) };
+		const float interpolatedDepth{ rowDepth + triangle.depth.ddx * static_cast<float>(lane) };
 
+		if constexpr (permutation.rasterPass == RasterPass::shadeEqualDepth)
+		{
+			//after a depth pre-pass only the exact winner is left
+			if (m_pDepthBufferPixels[pixelIdx + lane] != interpolatedDepth) continue;
+		}
+		else
+		{
+			if (m_pDepthBufferPixels[pixelIdx + lane] < interpolatedDepth) continue;
 
-	const float specularExp{ specularShininess * m_pGlossinessMap->Sample(v.uv).r };
+			// Save the new depth
+			m_pDepthBufferPixels[pixelIdx + lane] = interpolatedDepth;
+		}
 
-	const ColorRGB specular{ m_pSpecularMap->Sample(v.uv) * powf(cosAlpha, specularExp) };
+		passMask |= 1u << lane;
+		batch.depth[lane] = interpolatedDepth;
 
-	ColorRGB finalColor{ 0,0,0 };
+		//visibility buffer: only remember who won, attributes are interpolated once in the shading pass
+		if constexpr (permutation.rasterPass == RasterPass::visibility)
+		{
+			m_pVisibilityBuffer[pixelIdx + lane] = static_cast<uint32_t>(&triangle - m_TriangleSetups.data());
+		}
 
-	switch (m_ShadingMode)
+		if constexpr (permutation.UsesVaryings())
+		{
+			InterpolateLane<PixelShaderType>(triangle, px, py, lane, batch);
+		}
+	}
+
+	if (!passMask) return;
+
+	if constexpr (permutation.countFragments) CountFragments<permutation>(passMask, fragmentStats);
+
+	if constexpr (permutation.IsShaded())
 	{
-	case ShadingMode::observed:
+		ShadeRow<permutation>(px, py, passMask, batch, pPixelShader);
+	}
+}
+
+template<typename PixelShaderType>
+void Renderer::InterpolateLane(const TriangleSetup& triangle, int px, int py, int lane, PixelBatch& batch) const
+{
+	const float offsetX{ static_cast<float>(px - triangle.referenceX) };
+	const float offsetY{ static_cast<float>(py - triangle.referenceY) };
+	const auto interpolate = [&](const InterpolationPlane& plane)
+		{
+			const float rowValue{ plane.reference + plane.ddx * offsetX + plane.ddy * offsetY };
+			return rowValue + plane.ddx * static_cast<float>(lane);
+		};
+
+	const float interpolatedWDepth{ 1.f / interpolate(triangle.invWDepth) };
+	batch.wDepth[lane] = interpolatedWDepth;
+	batch.uvLods[lane] = triangle.uvLod;
+
+	//exactly the varyings the pixel shader declares
+	for (int varyingIdx{}; varyingIdx < nrVaryingFloats<typename PixelShaderType::Varyings>; ++varyingIdx)
 	{
-		finalColor += observedAreaRGB;
-		break;
+		batch.varyings[varyingIdx][lane] = interpolate(triangle.varyings[varyingIdx]) * interpolatedWDepth;
 	}
-	case ShadingMode::diffuse:
+}
+
+template<Renderer::RasterPermutation permutation, typename PixelShaderType>
+void Renderer::ShadeVisibilityBatch(int px, int py, uint32_t laneMask, const void* pPixelShader) const
+{
+	const int pixelIdx{ px + py * m_Width };
+
+	PixelBatch batch{};
+	for (uint32_t lanes{ laneMask }; lanes; lanes &= lanes - 1)
 	{
-		finalColor += lightIntensity * observedAreaRGB * TextureColor / PI;
-		break;
+		const int lane{ std::countr_zero(lanes) };
+		batch.depth[lane] = m_pDepthBufferPixels[pixelIdx + lane];
+
+		if constexpr (permutation.UsesVaryings())
+		{
+			InterpolateLane<PixelShaderType>(m_TriangleSetups[m_pVisibilityBuffer[pixelIdx + lane]], px, py, lane, batch);
+		}
+	}
+
+	ShadeRow<permutation>(px, py, laneMask, batch, GetPixelShader<PixelShaderType>(pPixelShader));
+}
+
+template<Renderer::RasterPermutation permutation, typename PixelShaderType>
+void Renderer::ShadeRow(int px, int py, uint32_t passMask, const PixelBatch& batch, const PixelShaderType* pPixelShader) const
+{
+	const int pixelIdx{ px + py * m_Width };
+
+	ColorBatch colors{};
+
+	//Update Color in Buffer
+	if constexpr (permutation.displayMode == DisplayMode::finalColor && permutation.useAvx2 && BatchPixelShader<PixelShaderType>)
+	{
+		//all lanes in one call
+		pPixelShader->ShadeBatch(FragmentBatch{ batch.varyings, batch.uvLods, passMask }, colors);
 	}
-	case ShadingMode::specular:
+	else
 	{
-		finalColor += specular; // *observedAreaRGB;
-		break;
+		for (uint32_t lanes{ passMask }; lanes; lanes &= lanes - 1)
+		{
+			const int lane{ std::countr_zero(lanes) };
+
+			ColorRGB finalColor{ 0,0,0 };
+
+			if constexpr (permutation.displayMode == DisplayMode::finalColor)
+			{
+				using Varyings = typename PixelShaderType::Varyings;
+
+				//the lane back into the varyings struct the pixel shader declared
+				float varyingFloats[nrVaryingFloats<Varyings>]{};
+				for (int varyingIdx{}; varyingIdx < nrVaryingFloats<Varyings>; ++varyingIdx)
+				{
+					varyingFloats[varyingIdx] = batch.varyings[varyingIdx][lane];
+				}
+
+				Varyings varyings{};
+				std::memcpy(&varyings, varyingFloats, sizeof(Varyings));
+
+				finalColor = pPixelShader->Shade(varyings, batch.uvLods[lane]);
+			}
+			else
+			{
+				const float depthBufferColor = Remap(batch.depth[lane], 0.995f, 1.0f);
+
+				finalColor = { depthBufferColor, depthBufferColor, depthBufferColor };
+			}
+
+			colors.r[lane] = finalColor.r;
+			colors.g[lane] = finalColor.g;
+			colors.b[lane] = finalColor.b;
+		}
 	}
-	case ShadingMode::combined:
+
+#if defined(DAE_AVX2_KERNELS)
+	if constexpr (permutation.useAvx2)
 	{
-		finalColor += (lightIntensity * TextureColor / PI + specular) * observedAreaRGB;
-		break;
+		//all lanes at once, only for 32-bit pixels with 8-bit channels
+		const SDL_PixelFormat* pFormat{ m_pBackBuffer->format };
+		if (pFormat->BytesPerPixel == 4 && !pFormat->Rloss && !pFormat->Gloss && !pFormat->Bloss)
+		{
+			StorePixelsAvx2(colors, passMask, pFormat, m_pBackBufferPixels + pixelIdx);
+			return;
+		}
 	}
+#endif
+
+	for (; passMask; passMask &= passMask - 1)
+	{
+		const int lane{ std::countr_zero(passMask) };
+
+		ColorRGB finalColor{ colors.r[lane], colors.g[lane], colors.b[lane] };
+		finalColor.MaxToOne();
+
+		m_pBackBufferPixels[pixelIdx + lane] = SDL_MapRGB(m_pBackBuffer->format,
+			static_cast<uint8_t>(finalColor.r * 255),
+			static_cast<uint8_t>(finalColor.g * 255),
+			static_cast<uint8_t>(finalColor.b * 255));
 	}
+}
 
-	const ColorRGB ambient{ .05f,.05f,.05f };
-	finalColor += ambient;
-	finalColor.MaxToOne();
+template<ShaderVaryings Varyings, typename VertexShaderType>
+void Renderer::VertexTransformationFunction(const VertexStreams& vertices_in, const VertexShaderType& vertexShader, Vector4* positions_out) const
+{
+	//vertices are independent: chunks spread over the thread pool, every chunk writes its own range of the outputs
+	const uint32_t nrVertices{ static_cast<uint32_t>(vertices_in.GetNrVertices()) };
+	m_pThreadPool->ParallelFor((nrVertices + vertexChunkSize - 1) / vertexChunkSize, [&](uint32_t chunkIdx)
+		{
+			const uint32_t firstVertexIdx{ chunkIdx * vertexChunkSize };
+			const uint32_t lastVertexIdx{ std::min(firstVertexIdx + vertexChunkSize, nrVertices) };
 
-	return finalColor;
+			if constexpr (BatchVertexShader<VertexShaderType, Varyings>)
+			{
+				vertexShader.TransformPositions(std::span{ vertices_in.positions }.subspan(firstVertexIdx, lastVertexIdx - firstVertexIdx),
+					std::span{ positions_out + firstVertexIdx, lastVertexIdx - firstVertexIdx });
+			}
+			else
+			{
+				for (uint32_t vertexIdx{ firstVertexIdx }; vertexIdx < lastVertexIdx; ++vertexIdx)
+				{
+					positions_out[vertexIdx] = vertexShader.TransformPosition(vertices_in.positions[vertexIdx]);
+				}
+			}
+		});
+}
+
+template<typename VertexShaderType, ShaderVaryings Varyings>
+void Renderer::ComputeVisibleVaryings(const VertexStreams& vertices_in, const VertexShaderType& vertexShader, Varyings* varyings_out)
+{
+	//one bit per mesh vertex a visible triangle references, the vertices clipping added already have their varyings
+	const uint32_t nrVertices{ static_cast<uint32_t>(vertices_in.GetNrVertices()) };
+	const uint32_t nrWords{ (nrVertices + 63) / 64 };
+	uint64_t* pReferenced{ m_FrameArena.Allocate<uint64_t>(nrWords) };
+	std::fill_n(pReferenced, nrWords, uint64_t{});
+
+	uint32_t nrReferenced{};
+	for (const uint32_t vertexIdx : m_VisibleIndices)
+	{
+		if (vertexIdx >= nrVertices) continue;
+
+		const uint64_t bit{ uint64_t{ 1 } << (vertexIdx % 64) };
+		if (pReferenced[vertexIdx / 64] & bit) continue;
+
+		pReferenced[vertexIdx / 64] |= bit;
+		++nrReferenced;
+	}
+
+	m_CullStats.nrVertices += nrVertices;
+	m_CullStats.nrVaryingsComputed += nrReferenced;
+	m_CullStats.nrVaryingsSkipped += nrVertices - nrReferenced;
+
+	//chunks are a multiple of 64 vertices, so every chunk owns whole words of the bitmap
+	static_assert(vertexChunkSize % 64 == 0);
+	m_pThreadPool->ParallelFor((nrVertices + vertexChunkSize - 1) / vertexChunkSize, [&](uint32_t chunkIdx)
+		{
+			const uint32_t firstWordIdx{ chunkIdx * (vertexChunkSize / 64) };
+			const uint32_t lastWordIdx{ std::min(firstWordIdx + vertexChunkSize / 64, nrWords) };
+
+			for (uint32_t wordIdx{ firstWordIdx }; wordIdx < lastWordIdx; ++wordIdx)
+			{
+				if constexpr (BatchVaryingsVertexShader<VertexShaderType, Varyings>)
+				{
+					//the referenced vertices of a word in one call
+					static_assert(maxVaryingsBatchSize >= 64);
+					uint32_t vertexIndices[64];
+					uint32_t nrVertexIndices{};
+					for (uint64_t word{ pReferenced[wordIdx] }; word; word &= word - 1)
+					{
+						vertexIndices[nrVertexIndices++] = wordIdx * 64 + static_cast<uint32_t>(std::countr_zero(word));
+					}
+					if (nrVertexIndices) vertexShader.ComputeVaryingsBatch(vertices_in, std::span{ vertexIndices, nrVertexIndices }, varyings_out);
+				}
+				else
+				{
+					for (uint64_t word{ pReferenced[wordIdx] }; word; word &= word - 1)
+					{
+						const uint32_t vertexIdx{ wordIdx * 64 + static_cast<uint32_t>(std::countr_zero(word)) };
+						varyings_out[vertexIdx] = vertexShader.ComputeVaryings(vertices_in, vertexIdx);
+					}
+				}
+			}
+		});
+}
+
+void Renderer::VertexTransformationToScreenSpace(std::span<const Vector4> positions_clip, Vector4* positions_ndc, Vector2* vertices_screen) const
+{
+	const uint32_t nrVertices{ static_cast<uint32_t>(positions_clip.size()) };
+	m_pThreadPool->ParallelFor((nrVertices + vertexChunkSize - 1) / vertexChunkSize, [&](uint32_t chunkIdx)
+		{
+			const uint32_t firstVertexIdx{ chunkIdx * vertexChunkSize };
+			const uint32_t lastVertexIdx{ std::min(firstVertexIdx + vertexChunkSize, nrVertices) };
+
+			for (uint32_t vertexIdx{ firstVertexIdx }; vertexIdx < lastVertexIdx; ++vertexIdx)
+			{
+				//perspective divide, w is kept for the perspective correct interpolation
+				//vertices behind the camera end up as garbage, but clipping made sure no visible triangle uses them
+				const Vector4& clipPosition{ positions_clip[vertexIdx] };
+				const Vector4 ndcPosition{ clipPosition.x / clipPosition.w, clipPosition.y / clipPosition.w, clipPosition.z / clipPosition.w, clipPosition.w };
+				positions_ndc[vertexIdx] = ndcPosition;
+
+				vertices_screen[vertexIdx] = {
+					m_Width * ((ndcPosition.x + 1) / 2.0f),
+					m_Height * ((1.0f - ndcPosition.y) / 2.0f)
+				};
+			}
+		});
 }
 
 void Renderer::RotateMesh(float elapsedSec)
@@ -749,6 +1558,67 @@ void Renderer::HandleKeyInput()
 		}
 	}
 
+	if(pKeyboardState[SDL_SCANCODE_F6])
+	{
+		switch(m_RasterMode)
+		{
+		case RasterMode::blocks:
+		{
+			m_RasterMode = RasterMode::scanline;
+			break;
+		}
+		case RasterMode::scanline:
+		{
+			m_RasterMode = RasterMode::blocks;
+			break;
+		}
+		}
+	}
+
+	if(pKeyboardState[SDL_SCANCODE_F8])
+	{
+		switch(m_PipelineMode)
+		{
+		case PipelineMode::forward:
+		{
+			m_PipelineMode = PipelineMode::depthPrepass;
+			break;
+		}
+		case PipelineMode::depthPrepass:
+		{
+			m_PipelineMode = PipelineMode::visibilityBuffer;
+			break;
+		}
+		case PipelineMode::visibilityBuffer:
+		{
+			m_PipelineMode = PipelineMode::forward;
+			break;
+		}
+		}
+	}
+
+	if(pKeyboardState[SDL_SCANCODE_C])
+	{
+		switch(m_CullMode)
+		{
+		case CullMode::back:
+		{
+			m_CullMode = CullMode::front;
+			break;
+		}
+		case CullMode::front:
+		{
+			m_CullMode = CullMode::none;
+			break;
+		}
+		case CullMode::none:
+		{
+			m_CullMode = CullMode::back;
+			break;
+		}
+		}
+	}
+
 	if(pKeyboardState[SDL_SCANCODE_F7])
 	{
 		switch(m_ShadingMode)
@@ -792,6 +1662,15 @@ void Renderer::ResetDepthBuffer() const
 {
 	const int nrPixels{ m_Width * m_Height };
 	std::fill_n(m_pDepthBufferPixels, nrPixels, FLT_MAX);
+
+	//hi-z is just a fill, it only ever shrinks while rendering
+	std::fill_n(m_pHiZBlocks, m_NrBlocksX * m_NrBlocksY, FLT_MAX);
+	std::fill_n(m_pHiZTiles, m_NrTilesX * m_NrTilesY, FLT_MAX);
+
+	if (m_PipelineMode == PipelineMode::visibilityBuffer)
+	{
+		std::fill_n(m_pVisibilityBuffer, nrPixels, invalidTriangleIdx);
+	}
 }
 
 
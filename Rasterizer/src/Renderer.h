@@ -1,21 +1,31 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <span>
 #include <vector>
 
 #include "Camera.h"
+#include "CpuFeatures.h"
+#include "FrameArena.h"
+#include "PhongShader.h"
+#include "Rasterization.h"
+#include "Shader.h"
 
 struct SDL_Window;
 struct SDL_Surface;
 
 namespace dae
 {
-	struct Vertex_Out;
 	class Texture;
 	struct Mesh;
-	struct Vertex;
+	struct VertexStreams;
 	class Timer;
 	class Scene;
+	class ThreadPool;
+	enum class PrimitiveTopology;
 
 	class Renderer final
 	{
@@ -29,21 +39,31 @@ namespace dae
 		Renderer& operator=(Renderer&&) noexcept = delete;
 
 		void Update(Timer* pTimer);
-		void Render() const;
-			
+		void Render();
+
 
 		bool SaveBufferToImage() const;
 
-		void VertexTransformationFunction(const std::vector<Vertex>& vertices_in, std::vector<Vertex>& vertices_out) const;
+		//runs a mesh through the vertex stage, clipping, culling and binning with its own shader pair
+		//the pixel shader is copied into the draw call and rasterized by kernels instantiated for its type, shaders must be
+		//instantiated in Renderer.cpp (see SubmitPhongMesh)
+		template<typename VertexShaderType, PixelShader PixelShaderType>
+			requires VertexShader<VertexShaderType, typename PixelShaderType::Varyings>
+		void SubmitMesh(const Mesh& mesh, const VertexShaderType& vertexShader, const PixelShaderType& pixelShader);
 
-		void VertexTransformationToScreenSpace(const std::vector<Vertex_Out>& vertices_in, std::vector<Vector2>& vertex_out) const;
+		//the vertex stage runs in chunks on the thread pool and writes into preallocated outputs (one element per vertex)
+		//perspective divide + viewport in one pass
+		void VertexTransformationToScreenSpace(std::span<const Vector4> positions_clip, Vector4* positions_ndc, Vector2* vertices_screen) const;
 
-		void VertexTransformationFunction(const std::vector<Vertex>& vertices_in, std::vector<Vertex_Out>& vertices_out, const Matrix& worldViewProjectionMatrix, const Matrix& meshWorldMatrix) const;
+		//the vertex stage is split in two: the positions of every vertex first, clipping and culling only need those
+		//the varyings are computed afterwards, only for the vertices a surviving triangle references
+		template<ShaderVaryings Varyings, typename VertexShaderType>
+		void VertexTransformationFunction(const VertexStreams& vertices_in, const VertexShaderType& vertexShader, Vector4* positions_out) const;
+		template<typename VertexShaderType, ShaderVaryings Varyings>
+		void ComputeVisibleVaryings(const VertexStreams& vertices_in, const VertexShaderType& vertexShader, Varyings* varyings_out);
 
-		void RenderTriangle() const;
-		void RenderTriangleStrip(std::vector<Mesh>& meshes_world, std::vector<Vertex_Out>& vertices_ndc,std::vector<Vector2>&vertices_screen) const;
+		void CullTriangles(const Vector2* vertices_screen);
 
-		ColorRGB PixelShading( Vertex_Out& v) const;
 
 		void RotateMesh(float elapsedSec);
 		void ClearBackground() const;
@@ -54,19 +74,222 @@ namespace dae
 			depthBuffer,
 			finalColor
 		};
-		enum class ShadingMode
-		{
-			observed,
-			diffuse,
-			specular,
-			combined
-		};
+		using ShadingMode = dae::ShadingMode;
 		enum class State
 		{
 			rotate,
 			idle
 		};
+		enum class RasterMode
+		{
+			blocks,		//8x8 blocks over the bounding box, trivial accept/reject per block
+			scanline	//exact span per row, walked left to right
+		};
+
+		enum class PipelineMode
+		{
+			forward,			//shade every fragment that passes the depth test
+			depthPrepass,		//depth of all meshes first, then shade the fragments with equal depth
+			visibilityBuffer	//rasterize triangle ids + depth only, then shade every pixel once
+		};
+		enum class CullMode
+		{
+			back,	//cull triangles facing away from the camera
+			front,	//cull triangles facing the camera
+			none
+		};
+
+		//counted over all meshes of the last rendered frame, the facing counters include the triangles made by clipping
+		struct CullStats
+		{
+			uint32_t nrTriangles{};
+			uint32_t nrFrustumCulled{};
+			uint32_t nrClipped{};			//went through the clipper (near/far plane or outside the guard band)
+			uint32_t nrGuardBandAccepted{};	//crosses a screen edge, only scissored
+			uint32_t nrBackFacesCulled{};
+			uint32_t nrFrontFacesCulled{};
+			uint32_t nrDegenerateCulled{};
+
+			uint32_t nrVertices{};
+			uint32_t nrVaryingsComputed{};	//per vertex a surviving triangle references, plus the corners of clipped triangles
+			uint32_t nrVaryingsSkipped{};	//vertices no surviving triangle references, their attributes were never transformed
+		};
+
+		//counted over the last rendered frame, only while fragment counting is on
+		struct FragmentStats
+		{
+			uint64_t nrDepthTestPassed{};	//what a single forward pass would shade
+			uint64_t nrShaded{};
+		};
+
+		void SetRasterMode(RasterMode rasterMode) { m_RasterMode = rasterMode; }
+		RasterMode GetRasterMode() const { return m_RasterMode; }
+		void SetPipelineMode(PipelineMode pipelineMode) { m_PipelineMode = pipelineMode; }
+		PipelineMode GetPipelineMode() const { return m_PipelineMode; }
+		void SetCullMode(CullMode cullMode) { m_CullMode = cullMode; }
+		CullMode GetCullMode() const { return m_CullMode; }
+		const CullStats& GetCullStats() const { return m_CullStats; }
+		const FragmentStats& GetFragmentStats() const { return m_FragmentStats; }
+		//picks the raster permutations that count fragments, off by default so the kernels never touch the counters
+		void SetCountFragments(bool countFragments) { m_CountFragments = countFragments; }
+		bool GetCountFragments() const { return m_CountFragments; }
+		//the instruction set the raster, shading and color packing kernels run with, picked at construction from GetSimdLevel
+		SimdLevel GetRasterSimdLevel() const { return m_UseAvx2Kernels ? SimdLevel::avx2 : SimdLevel::scalar; }
 	private:
+		//what the raster kernel does with the fragments that pass the depth test
+		enum class RasterPass
+		{
+			shade,
+			depthOnly,
+			shadeEqualDepth,	//depth test is buffer == depth, the buffer is not written
+			visibility			//write depth + triangle id
+		};
+
+		//every mode the raster kernel depends on, each combination is its own instantiation without mode branches
+		//the kernels are instantiated per pixel shader on top of that, only when the permutation runs it
+		struct RasterPermutation
+		{
+			RasterPass rasterPass{};
+			DisplayMode displayMode{};
+			bool useAvx2{};	//the AVX2 kernels, or the scalar ones that do the same math one lane at a time
+			bool countFragments{};	//fill FragmentStats
+
+			constexpr bool IsShaded() const { return rasterPass == RasterPass::shade || rasterPass == RasterPass::shadeEqualDepth; }
+			constexpr bool UsesVaryings() const { return IsShaded() && displayMode == DisplayMode::finalColor; }
+		};
+
+		//raster pass x display mode x kernel instruction set x fragment counting
+		static constexpr int nrRasterPermutations{ 4 * 2 * 2 * 2 };
+		static constexpr int GetPermutationIndex(RasterPass rasterPass, DisplayMode displayMode, bool useAvx2, bool countFragments);
+		static constexpr RasterPermutation GetPermutation(int permutationIdx);
+
+		//screen space plane: value = reference + ddx * (px - referenceX) + ddy * (py - referenceY)
+		struct InterpolationPlane
+		{
+			float ddx{};
+			float ddy{};
+			float reference{};
+		};
+
+		//everything the raster loop needs for a triangle that survived culling, built once in triangle setup
+		struct TriangleSetup
+		{
+			//bounding box clamped to the screen (max is exclusive)
+			int minX{};
+			int minY{};
+			int maxX{};
+			int maxY{};
+
+			//edges[i] is the edge opposite vertex i, its value divided by the area is the weight of vertex i
+			EdgeFunction edges[3]{};
+			float invArea{};
+
+			//pixel the planes are relative to
+			int referenceX{};
+			int referenceY{};
+
+			InterpolationPlane depth{};
+			float minDepth{};
+			float maxDepth{};
+			InterpolationPlane invWDepth{};
+
+			uint32_t drawCallIdx{};
+			//log2 of the uv distance between neighbouring pixels, 0 when the varyings have no uv
+			float uvLod{};
+
+			//varyings of the pixel shader divided by w, only the first nrVaryingFloats are set
+			InterpolationPlane varyings[maxVaryingFloats]{};
+		};
+
+		//one row of 8 pixels in structure-of-arrays form, filled by the raster kernel for the shading
+		struct PixelBatch
+		{
+			alignas(32) float depth[8];
+			alignas(32) float wDepth[8];
+			alignas(32) float uvLods[8];
+			alignas(32) float varyings[maxVaryingFloats][8];
+		};
+
+		//pixel shader type erased per triangle: one indirect call per triangle (or per visibility batch), never per fragment
+		//permutations that don't run the pixel shader point to the shared instantiations with PixelShaderType = void
+		//fragments are counted into the FragmentStats of the tile, it only goes to the shared counters once the tile is done
+		using RasterizeTriangleFunction = bool (Renderer::*)(const TriangleSetup&, int, int, int, int, const void*, FragmentStats&) const;
+		using ShadeVisibilityBatchFunction = void (Renderer::*)(int, int, uint32_t, const void*) const;
+
+		//one submitted mesh: its pixel shader and the kernels instantiated for it
+		struct DrawCall
+		{
+			std::array<RasterizeTriangleFunction, nrRasterPermutations> rasterizeTriangle{};
+			std::array<ShadeVisibilityBatchFunction, 2 * 2> shadeVisibilityBatch{};	//per kernel instruction set x display mode
+			alignas(16) std::byte pixelShader[maxPixelShaderSize]{};
+		};
+
+		//per vertex output of the vertex stage: the mesh vertices, then the vertices clipping added (vertex index nrVertices + i)
+		template<typename T>
+		struct VertexOutputStream
+		{
+			const T* pVertices{};
+			uint32_t nrVertices{};
+			const ArenaVector<T>& clippedVertices;
+
+			const T& operator[](uint32_t vertexIdx) const { return vertexIdx < nrVertices ? pVertices[vertexIdx] : clippedVertices[vertexIdx - nrVertices]; }
+		};
+
+		//appends the polygons of clipped triangles to clippedPositions/clippedVaryings
+		//the varyings of the corners of a clipped triangle are computed right there, the vertex stage hasn't done them yet
+		template<PrimitiveTopology topology, typename VertexShaderType, ShaderVaryings Varyings>
+		void ClipTriangles(const Mesh& mesh, const Vector4* positions_clip, const VertexShaderType& vertexShader, ArenaVector<Vector4>& clippedPositions, ArenaVector<Varyings>& clippedVaryings);
+		template<ShaderVaryings Varyings>
+		void SetupTriangles(const Vector4* positions_ndc, const VertexOutputStream<Varyings>& varyings, const Vector2* vertices_screen, uint32_t drawCallIdx);
+		//sorts the triangle setups of all meshes into screen tiles
+		void BinTriangles();
+		bool SetupTriangle(const Vector2& v0, const Vector2& v1, const Vector2& v2, TriangleSetup& triangle) const;
+		//varyingsN points to the nrVaryings floats of vertex N
+		void SetupInterpolationPlanes(const Vector4& position0, const Vector4& position1, const Vector4& position2,
+			const float* varyings0, const float* varyings1, const float* varyings2, int nrVaryings, TriangleSetup& triangle) const;
+		template<bool useAvx2>
+		uint64_t ComputeBlockCoverage(const TriangleSetup& triangle, int blockX, int blockY, const int64_t blockWeights[3], int minX, int minY, int maxX, int maxY) const;
+
+		//the built-in vehicle material, shading mode + normal map pick the pixel shader type
+		template<ShadingMode shadingMode, bool useNormalMap>
+		void SubmitPhongMesh(const Mesh& mesh, const Matrix& worldViewProjectionMatrix);
+
+		//pick the permutation once per pass, the draw call of every triangle picks the kernels of its pixel shader
+		void RasterizeTiles(RasterPass rasterPass);
+		void ShadeVisibilityBuffer();
+		void RasterizeTile(uint32_t tileIdx, int permutationIdx) const;
+		std::span<const uint32_t> GetTileBin(uint32_t tileIdx) const;
+		void ShadeVisibilityRow(int py) const;
+		//returns true when the hi-z of a block got lower
+		template<RasterPermutation permutation, typename PixelShaderType>
+		bool RasterizeTriangle(const TriangleSetup& triangle, int minX, int minY, int maxX, int maxY, const void* pPixelShader, FragmentStats& fragmentStats) const;
+		template<RasterPermutation permutation, typename PixelShaderType>
+		bool RasterizeTriangleBlocks(const TriangleSetup& triangle, int minX, int minY, int maxX, int maxY, const PixelShaderType* pPixelShader, FragmentStats& fragmentStats) const;
+		template<RasterPermutation permutation, typename PixelShaderType>
+		bool RasterizeTriangleSpans(const TriangleSetup& triangle, int minX, int minY, int maxX, int maxY, const PixelShaderType* pPixelShader, FragmentStats& fragmentStats) const;
+		//the triangle fully covered the block: its hi-z drops to the triangle's max depth over it, returns true when it got lower
+		bool LowerBlockHiZ(const TriangleSetup& triangle, int blockX, int blockY) const;
+		template<RasterPermutation permutation, typename PixelShaderType>
+		void RasterizeBlock(const TriangleSetup& triangle, int blockX, int blockY, uint64_t coverage, const PixelShaderType* pPixelShader, FragmentStats& fragmentStats) const;
+		//8-wide raster kernel: depth test and interpolation, AVX2 or the scalar fallback depending on the permutation
+		template<RasterPermutation permutation, typename PixelShaderType>
+		void RasterizeRow(const TriangleSetup& triangle, int px, int py, uint32_t rowCoverage, const PixelShaderType* pPixelShader, FragmentStats& fragmentStats) const;
+		template<RasterPermutation permutation, typename PixelShaderType>
+		DAE_TARGET_AVX2 void RasterizeRowAvx2(const TriangleSetup& triangle, int px, int py, uint32_t rowCoverage, const PixelShaderType* pPixelShader, FragmentStats& fragmentStats) const;
+		template<RasterPermutation permutation, typename PixelShaderType>
+		void RasterizeRowScalar(const TriangleSetup& triangle, int px, int py, uint32_t rowCoverage, const PixelShaderType* pPixelShader, FragmentStats& fragmentStats) const;
+		//adds the fragments of one row that passed the depth test to the tile counters
+		template<RasterPermutation permutation>
+		static void CountFragments(uint32_t passMask, FragmentStats& fragmentStats);
+		//fills one lane of the batch with the perspective correct varyings at pixel (px + lane, py)
+		template<typename PixelShaderType>
+		void InterpolateLane(const TriangleSetup& triangle, int px, int py, int lane, PixelBatch& batch) const;
+		//shades the lanes of one 8 pixel batch of the visibility buffer that belong to the same draw call
+		template<RasterPermutation permutation, typename PixelShaderType>
+		void ShadeVisibilityBatch(int px, int py, uint32_t laneMask, const void* pPixelShader) const;
+		template<RasterPermutation permutation, typename PixelShaderType>
+		void ShadeRow(int px, int py, uint32_t passMask, const PixelBatch& batch, const PixelShaderType* pPixelShader) const;
+
 		SDL_Window* m_pWindow{};
 
 		SDL_Surface* m_pFrontBuffer{ nullptr };
@@ -74,6 +297,31 @@ namespace dae
 		uint32_t* m_pBackBufferPixels{};
 
 		float* m_pDepthBufferPixels{};
+		//index into m_TriangleSetups per pixel, the planes in there double as barycentrics
+		uint32_t* m_pVisibilityBuffer{};
+
+		//hierarchical z: conservative max depth per 8x8 block and per tile, rebuilt in ResetDepthBuffer
+		int m_NrBlocksX{};
+		int m_NrBlocksY{};
+		float* m_pHiZBlocks{};
+		float* m_pHiZTiles{};
+
+		//binned tile rasterizer
+		const int m_TileSize{ 64 };
+		int m_NrTilesX{};
+		int m_NrTilesY{};
+		//picks the raster permutations, decided once in the constructor
+		bool m_UseAvx2Kernels{};
+		//everything a frame builds is allocated in the frame arena, it is reset at the start of Render
+		//so the steady state frame never touches the heap
+		FrameArena m_FrameArena{};
+		ArenaVector<uint32_t> m_VisibleIndices{ m_FrameArena };
+		ArenaVector<TriangleSetup> m_TriangleSetups{ m_FrameArena };
+		ArenaVector<DrawCall> m_DrawCalls{ m_FrameArena };
+		//triangle indices sorted by tile, the bin of tile i starts at m_pTileBinOffsets[i] and ends at m_pTileBinOffsets[i + 1]
+		uint32_t* m_pTileBinOffsets{};
+		uint32_t* m_pTileBinTriangles{};
+		ThreadPool* m_pThreadPool{};
 
 		Camera m_Camera{};
 
@@ -84,10 +332,7 @@ namespace dae
 
 		std::vector<Mesh>m_MeshesWorld;
 		Matrix m_MeshOriginalWorldMatrix{};
-		Texture* m_pTexture{};
-		Texture* m_pNormalMap{};
-		Texture* m_pGlossinessMap{};
-		Texture* m_pSpecularMap{};
+		Texture* m_pMaterial{};
 
 		bool m_DepthBuffer{false};
 		bool m_UseNormalMap{ false };
@@ -98,5 +343,13 @@ namespace dae
 		DisplayMode m_displayMode{ DisplayMode::finalColor };
 		ShadingMode m_ShadingMode{ ShadingMode::combined };
 		State m_State{ State::idle };
+		RasterMode m_RasterMode{ RasterMode::blocks };
+		PipelineMode m_PipelineMode{ PipelineMode::forward };
+		CullMode m_CullMode{ CullMode::back };
+		CullStats m_CullStats{};
+		FragmentStats m_FragmentStats{};
+		bool m_CountFragments{ false };
+		mutable std::atomic<uint64_t> m_NrDepthTestPassed{};
+		mutable std::atomic<uint64_t> m_NrShaded{};
 	};
 }
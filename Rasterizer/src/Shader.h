@@ -0,0 +1,91 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+
+#include "DataTypes.h"
+
+namespace dae
+{
+	//most floats a varyings struct can hold, the triangle setup keeps one interpolation plane per float
+	constexpr int maxVaryingFloats{ 12 };
+
+	//pixel shaders are copied into the draw call by value
+	constexpr int maxPixelShaderSize{ 64 };
+
+	//what the vertex shader hands to the pixel shader: a plain struct of floats (Vector2, Vector3, ...)
+	//every float is interpolated perspective correct
+	template<typename Type>
+	concept ShaderVaryings = std::is_trivially_copyable_v<Type> && std::is_default_constructible_v<Type>
+		&& alignof(Type) == alignof(float) && sizeof(Type) % sizeof(float) == 0 && sizeof(Type) / sizeof(float) <= maxVaryingFloats;
+
+	template<ShaderVaryings Varyings>
+	constexpr int nrVaryingFloats{ static_cast<int>(sizeof(Varyings) / sizeof(float)) };
+
+	//runs once per shaded fragment and declares the varyings it reads
+	//uvLod is the log2 of the uv distance between neighbouring pixels, for Texture::Sample, taken from a Varyings member named uv
+	//a small value type (uniforms + texture pointers), the raster kernels are instantiated per pixel shader type
+	template<typename Shader>
+	concept PixelShader = ShaderVaryings<typename Shader::Varyings>
+		&& std::is_trivially_copyable_v<Shader> && sizeof(Shader) <= maxPixelShaderSize && alignof(Shader) <= 16
+		&& requires(const Shader& shader, const typename Shader::Varyings& varyings)
+	{
+		{ shader.Shade(varyings, 0.f) } -> std::same_as<ColorRGB>;
+	};
+
+	//8 fragments in structure-of-arrays form: varyings[i][lane] is float i of the varyings struct
+	//use offsetof(Varyings, member) / sizeof(float) to find a member
+	struct FragmentBatch
+	{
+		const float (*varyings)[8]{};
+		const float* uvLods{};	//per lane, see PixelShader
+		uint32_t laneMask{};	//lanes to shade, the others hold garbage
+	};
+
+	//8 colors in structure-of-arrays form
+	struct ColorBatch
+	{
+		alignas(32) float r[8];
+		alignas(32) float g[8];
+		alignas(32) float b[8];
+	};
+
+	//a pixel shader that can also shade a whole batch in one call, vectorized over the lanes
+	//the raster kernels prefer it over one Shade call per fragment
+	template<typename Shader>
+	concept BatchPixelShader = PixelShader<Shader> && requires(const Shader& shader, const FragmentBatch& fragments, ColorBatch& colors)
+	{
+		shader.ShadeBatch(fragments, colors);
+	};
+
+	//runs once per vertex: clip space position + the varyings of the pixel shader it is paired with
+	//the position comes on its own, the varyings read only the attribute streams they need
+	template<typename Shader, typename Varyings>
+	concept VertexShader = requires(const Shader& shader, const Vector3& position, const VertexStreams& vertices, uint32_t vertexIdx)
+	{
+		{ shader.TransformPosition(position) } -> std::same_as<Vector4>;
+		{ shader.ComputeVaryings(vertices, vertexIdx) } -> std::same_as<Varyings>;
+	};
+
+	//a vertex shader that can also transform a whole range of positions in one call (see Matrix::TransformPoints)
+	//the vertex stage prefers it over one TransformPosition call per vertex
+	template<typename Shader, typename Varyings>
+	concept BatchVertexShader = VertexShader<Shader, Varyings> && requires(const Shader& shader, std::span<const Vector3> positions, std::span<Vector4> positions_out)
+	{
+		shader.TransformPositions(positions, positions_out);
+	};
+
+	//the most vertices one ComputeVaryingsBatch call gets
+	constexpr size_t maxVaryingsBatchSize{ 64 };
+
+	//a vertex shader that can also compute the varyings of a list of vertices in one call (see Matrix::TransformVectors)
+	//varyings_out is indexed by vertex index, the vertex stage prefers it over one ComputeVaryings call per vertex
+	template<typename Shader, typename Varyings>
+	concept BatchVaryingsVertexShader = VertexShader<Shader, Varyings> && requires(const Shader& shader, const VertexStreams& vertices, std::span<const uint32_t> vertexIndices, Varyings* varyings_out)
+	{
+		shader.ComputeVaryingsBatch(vertices, vertexIndices, varyings_out);
+	};
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "CpuFeatures.h"
+
+//only call these from DAE_TARGET_AVX2 kernels picked at runtime for SimdLevel::avx2 or higher
+#if defined(DAE_AVX2_KERNELS)
+#include <immintrin.h>
+
+#include "Vector3.h"
+
+namespace dae
+{
+	//a * b + c, fused (the avx2 level requires FMA3)
+	DAE_TARGET_AVX2 inline __m256 MulAdd(__m256 a, __m256 b, __m256 c)
+	{
+		return _mm256_fmadd_ps(a, b, c);
+	}
+
+	//8 vectors in structure-of-arrays form, one lane per fragment
+	struct Vector3x8
+	{
+		__m256 x;
+		__m256 y;
+		__m256 z;
+	};
+
+	DAE_TARGET_AVX2 inline Vector3x8 Broadcast(const Vector3& v)
+	{
+		return { _mm256_set1_ps(v.x), _mm256_set1_ps(v.y), _mm256_set1_ps(v.z) };
+	}
+
+	DAE_TARGET_AVX2 inline __m256 Dot(const Vector3x8& a, const Vector3x8& b)
+	{
+		return MulAdd(a.x, b.x, MulAdd(a.y, b.y, _mm256_mul_ps(a.z, b.z)));
+	}
+
+	DAE_TARGET_AVX2 inline Vector3x8 Cross(const Vector3x8& a, const Vector3x8& b)
+	{
+		return
+		{
+			_mm256_sub_ps(_mm256_mul_ps(a.y, b.z), _mm256_mul_ps(a.z, b.y)),
+			_mm256_sub_ps(_mm256_mul_ps(a.z, b.x), _mm256_mul_ps(a.x, b.z)),
+			_mm256_sub_ps(_mm256_mul_ps(a.x, b.y), _mm256_mul_ps(a.y, b.x))
+		};
+	}
+
+	DAE_TARGET_AVX2 inline Vector3x8 Scale(const Vector3x8& v, __m256 scale)
+	{
+		return { _mm256_mul_ps(v.x, scale), _mm256_mul_ps(v.y, scale), _mm256_mul_ps(v.z, scale) };
+	}
+
+	//divides like Vector3::Normalized, so the result matches the scalar shading up to the fused multiply-adds
+	DAE_TARGET_AVX2 inline Vector3x8 Normalized(const Vector3x8& v)
+	{
+		const __m256 magnitude{ _mm256_sqrt_ps(Dot(v, v)) };
+		return { _mm256_div_ps(v.x, magnitude), _mm256_div_ps(v.y, magnitude), _mm256_div_ps(v.z, magnitude) };
+	}
+
+	//log2 of positive, normal floats (cephes logf polynomial, ~1 ulp)
+	DAE_TARGET_AVX2 inline __m256 Log2(__m256 x)
+	{
+		const __m256i bits{ _mm256_castps_si256(x) };
+		__m256 exponent{ _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127))) };
+		__m256 mantissa{ _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)), _mm256_set1_epi32(0x3F800000))) };
+
+		//mantissa in [sqrt(0.5), sqrt(2)) keeps the polynomial argument around 0
+		const __m256 isLarge{ _mm256_cmp_ps(mantissa, _mm256_set1_ps(1.41421356f), _CMP_GT_OQ) };
+		mantissa = _mm256_blendv_ps(mantissa, _mm256_mul_ps(mantissa, _mm256_set1_ps(.5f)), isLarge);
+		exponent = _mm256_add_ps(exponent, _mm256_and_ps(isLarge, _mm256_set1_ps(1.f)));
+
+		const __m256 f{ _mm256_sub_ps(mantissa, _mm256_set1_ps(1.f)) };
+		const __m256 f2{ _mm256_mul_ps(f, f) };
+
+		__m256 polynomial{ _mm256_set1_ps(7.0376836292e-2f) };
+		polynomial = MulAdd(polynomial, f, _mm256_set1_ps(-1.1514610310e-1f));
+		polynomial = MulAdd(polynomial, f, _mm256_set1_ps(1.1676998740e-1f));
+		polynomial = MulAdd(polynomial, f, _mm256_set1_ps(-1.2420140846e-1f));
+		polynomial = MulAdd(polynomial, f, _mm256_set1_ps(1.4249322787e-1f));
+		polynomial = MulAdd(polynomial, f, _mm256_set1_ps(-1.6668057665e-1f));
+		polynomial = MulAdd(polynomial, f, _mm256_set1_ps(2.0000714765e-1f));
+		polynomial = MulAdd(polynomial, f, _mm256_set1_ps(-2.4999993993e-1f));
+		polynomial = MulAdd(polynomial, f, _mm256_set1_ps(3.3333331174e-1f));
+
+		//ln(1 + f) = f - f^2 / 2 + f^3 * polynomial
+		const __m256 naturalLog{ _mm256_add_ps(f, MulAdd(_mm256_mul_ps(f2, f), polynomial, _mm256_mul_ps(f2, _mm256_set1_ps(-.5f)))) };
+		return MulAdd(naturalLog, _mm256_set1_ps(1.44269504f), exponent);
+	}
+
+	//2^x, clamped to the normal float range (cephes exp2f polynomial)
+	DAE_TARGET_AVX2 inline __m256 Exp2(__m256 x)
+	{
+		x = _mm256_max_ps(_mm256_min_ps(x, _mm256_set1_ps(127.f)), _mm256_set1_ps(-126.f));
+
+		const __m256 whole{ _mm256_round_ps(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC) };
+		const __m256 f{ _mm256_sub_ps(x, whole) };
+
+		__m256 polynomial{ _mm256_set1_ps(1.535336188319500e-4f) };
+		polynomial = MulAdd(polynomial, f, _mm256_set1_ps(1.339887440266574e-3f));
+		polynomial = MulAdd(polynomial, f, _mm256_set1_ps(9.618437357674640e-3f));
+		polynomial = MulAdd(polynomial, f, _mm256_set1_ps(5.550332471162809e-2f));
+		polynomial = MulAdd(polynomial, f, _mm256_set1_ps(2.402264791363012e-1f));
+		polynomial = MulAdd(polynomial, f, _mm256_set1_ps(6.931472028550421e-1f));
+		polynomial = MulAdd(polynomial, f, _mm256_set1_ps(1.f));
+
+		const __m256i scale{ _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(whole), _mm256_set1_epi32(127)), 23) };
+		return _mm256_mul_ps(polynomial, _mm256_castsi256_ps(scale));
+	}
+
+	//powf for base >= 0: pow(0, e) is 0, pow(b, 0) is 1
+	DAE_TARGET_AVX2 inline __m256 Pow(__m256 base, __m256 exponent)
+	{
+		const __m256 zero{ _mm256_setzero_ps() };
+		const __m256 power{ Exp2(_mm256_mul_ps(exponent, Log2(base))) };
+
+		__m256 result{ _mm256_blendv_ps(power, zero, _mm256_cmp_ps(base, zero, _CMP_LE_OQ)) };
+		result = _mm256_blendv_ps(result, _mm256_set1_ps(1.f), _mm256_cmp_ps(exponent, zero, _CMP_EQ_OQ));
+		return result;
+	}
+}
+#endif
@@ -5,9 +5,16 @@
 #undef main
 
 //Standard includes
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <iostream>
+#include <string>
 
 //Project includes
+#include "AllocationCounter.h"
+#include "CpuFeatures.h"
+#include "Texture.h"
 #include "Timer.h"
 #include "Renderer.h"
 
@@ -19,11 +26,217 @@ void ShutDown(SDL_Window* pWindow)
 	SDL_Quit();
 }
 
+//renders the same frame with every raster/pipeline mode and prints the average frame time of each
+void RunBenchmark(Renderer* pRenderer, Timer* pTimer)
+{
+	constexpr int nrWarmupFrames{ 10 };
+	constexpr int nrFrames{ 200 };
+
+	pRenderer->Update(pTimer);
+	//the kernels that count fragments only run here
+	pRenderer->SetCountFragments(true);
+
+	struct BenchmarkMode
+	{
+		Renderer::RasterMode rasterMode;
+		Renderer::PipelineMode pipelineMode;
+		const char* name;
+	};
+
+	const BenchmarkMode benchmarkModes[]
+	{
+		{ Renderer::RasterMode::blocks, Renderer::PipelineMode::forward, "blocks (bounding box)" },
+		{ Renderer::RasterMode::scanline, Renderer::PipelineMode::forward, "scanline spans" },
+		{ Renderer::RasterMode::blocks, Renderer::PipelineMode::depthPrepass, "depth pre-pass" },
+		{ Renderer::RasterMode::blocks, Renderer::PipelineMode::visibilityBuffer, "visibility buffer" }
+	};
+
+	for (const auto& [rasterMode, pipelineMode, name] : benchmarkModes)
+	{
+		pRenderer->SetRasterMode(rasterMode);
+		pRenderer->SetPipelineMode(pipelineMode);
+
+		for (int i{}; i < nrWarmupFrames; ++i)
+		{
+			pRenderer->Render();
+		}
+
+		const uint64_t nrHeapAllocations{ GetNrHeapAllocations() };
+		const auto start{ std::chrono::steady_clock::now() };
+		for (int i{}; i < nrFrames; ++i)
+		{
+			pRenderer->Render();
+		}
+		const std::chrono::duration<double, std::milli> duration{ std::chrono::steady_clock::now() - start };
+		//after the warmup the frame arena is big enough, this should stay 0
+		const uint64_t nrFrameHeapAllocations{ GetNrHeapAllocations() - nrHeapAllocations };
+
+		const Renderer::FragmentStats& fragmentStats{ pRenderer->GetFragmentStats() };
+		std::cout << "Benchmark " << name << ": " << duration.count() / nrFrames << " ms/frame, shaded "
+			<< fragmentStats.nrShaded << " of " << fragmentStats.nrDepthTestPassed << " fragments a single pass would shade, "
+			<< nrFrameHeapAllocations << " heap allocations in " << nrFrames << " frames" << std::endl;
+	}
+
+	const Renderer::CullStats& cullStats{ pRenderer->GetCullStats() };
+	std::cout << "Culled " << cullStats.nrBackFacesCulled << " back faces, " << cullStats.nrFrontFacesCulled << " front faces, "
+		<< cullStats.nrFrustumCulled << " outside the frustum and " << cullStats.nrDegenerateCulled << " degenerate of "
+		<< cullStats.nrTriangles << " triangles" << std::endl;
+	std::cout << "Clipped " << cullStats.nrClipped << " triangles, " << cullStats.nrGuardBandAccepted << " accepted by the guard band" << std::endl;
+	std::cout << "Computed the varyings of " << cullStats.nrVaryingsComputed << " vertices, skipped " << cullStats.nrVaryingsSkipped << " of "
+		<< cullStats.nrVertices << " no visible triangle uses" << std::endl;
+}
+
+//samples the diffuse map along rows rotated by a few angles, once per texel layout
+//at 90 degrees every sample of a row-major texture is on a new cache line
+void RunTextureBenchmark()
+{
+	constexpr int nrRows{ 256 };
+	constexpr int nrSamplesPerRow{ 1024 };
+	constexpr int nrRepeats{ 4 };
+	constexpr float angles[]{ 0.f, 45.f, 90.f };
+
+	for (const Texture::TexelLayout layout : { Texture::TexelLayout::rowMajor, Texture::TexelLayout::tiled })
+	{
+		const Texture* pTexture{ Texture::LoadFromFile("resources/vehicle_diffuse.png", nullptr, layout) };
+		if (!pTexture) return;
+
+		const float texelSize{ 1.f / static_cast<float>(pTexture->GetWidth()) };
+		for (const float angle : angles)
+		{
+			//one texel per sample along the row, one texel between rows
+			const Vector2 step{ std::cos(angle * TO_RADIANS) * texelSize, std::sin(angle * TO_RADIANS) * texelSize };
+			const Vector2 rowStep{ -step.y, step.x };
+
+			//the sum keeps the samples from being optimized away
+			float sum{};
+			const auto start{ std::chrono::steady_clock::now() };
+			for (int repeat{}; repeat < nrRepeats; ++repeat)
+			{
+				for (int row{}; row < nrRows; ++row)
+				{
+					Vector2 uv{ Vector2{ .5f, .5f } + rowStep * static_cast<float>(row - nrRows / 2) - step * static_cast<float>(nrSamplesPerRow / 2) };
+					for (int sample{}; sample < nrSamplesPerRow; ++sample)
+					{
+						sum += pTexture->Sample(uv).r;
+						uv += step;
+					}
+				}
+			}
+			const std::chrono::duration<double, std::nano> duration{ std::chrono::steady_clock::now() - start };
+
+			std::cout << "Texture benchmark " << (layout == Texture::TexelLayout::tiled ? "tiled" : "row-major") << ", rows at " << angle << " degrees: "
+				<< duration.count() / (nrRepeats * nrRows * nrSamplesPerRow) << " ns/sample (" << sum << ")" << std::endl;
+		}
+
+		delete pTexture;
+	}
+}
+
+//the vehicle material uncompressed and compressed: memory and sampling speed, 8 lanes at a time
+//the decoded block cache only exists for SampleMaterial, so it is compared against SampleMaterial without it
+//the rows are rotated by 45 degrees like above, the decode cost is what differs
+void RunMaterialBenchmark()
+{
+	constexpr int nrRows{ 256 };
+	constexpr int nrBatchesPerRow{ 128 };
+	constexpr int nrRepeats{ 4 };
+
+	struct MaterialBenchmark
+	{
+		Texture::MaterialFormat format;
+		bool useBatch;	//SampleMaterialBatch, or one SampleMaterial per lane
+		bool useDecodedBlockCache;
+		const char* name;
+	};
+
+	const MaterialBenchmark materialBenchmarks[]
+	{
+		{ Texture::MaterialFormat::uncompressed, true, false, "uncompressed, batch" },
+		{ Texture::MaterialFormat::compressed, true, false, "compressed, batch" },
+		{ Texture::MaterialFormat::compressed, false, false, "compressed, per sample" },
+		{ Texture::MaterialFormat::compressed, false, true, "compressed, per sample + decoded block cache" }
+	};
+
+	for (const auto& [format, useBatch, useDecodedBlockCache, name] : materialBenchmarks)
+	{
+		Texture* pMaterial{ Texture::LoadMaterialFromFiles("resources/vehicle_diffuse.png", "resources/vehicle_normal.png", "resources/vehicle_specular.png", "resources/vehicle_gloss.png",
+			nullptr, Texture::TexelLayout::tiled, format) };
+		if (!pMaterial) return;
+		pMaterial->SetDecodedBlockCache(useDecodedBlockCache);
+
+		const float texelSize{ 1.f / static_cast<float>(pMaterial->GetWidth()) };
+		const Vector2 step{ std::cos(45.f * TO_RADIANS) * texelSize, std::sin(45.f * TO_RADIANS) * texelSize };
+		const Vector2 rowStep{ -step.y, step.x };
+
+		alignas(32) float u[8];
+		alignas(32) float v[8];
+		//far below the full resolution level
+		alignas(32) float uvLods[8];
+		std::fill_n(uvLods, 8, -100.f);
+		Texture::MaterialBatch materials;
+
+		float sum{};
+		const auto start{ std::chrono::steady_clock::now() };
+		for (int repeat{}; repeat < nrRepeats; ++repeat)
+		{
+			for (int row{}; row < nrRows; ++row)
+			{
+				Vector2 uv{ Vector2{ .5f, .5f } + rowStep * static_cast<float>(row - nrRows / 2) - step * static_cast<float>(nrBatchesPerRow * 4) };
+				for (int batch{}; batch < nrBatchesPerRow; ++batch)
+				{
+					for (int lane{}; lane < 8; ++lane)
+					{
+						u[lane] = uv.x;
+						v[lane] = uv.y;
+						uv += step;
+					}
+					if (useBatch)
+					{
+						pMaterial->SampleMaterialBatch(u, v, uvLods, 0xFF, materials);
+						sum += materials.diffuse[0][0] + materials.normal[2][7];
+					}
+					else
+					{
+						for (int lane{}; lane < 8; ++lane)
+						{
+							const Texture::MaterialSample material{ pMaterial->SampleMaterial(Vector2{ u[lane], v[lane] }, uvLods[lane]) };
+							sum += material.diffuse.r + material.normal.z;
+						}
+					}
+				}
+			}
+		}
+		const std::chrono::duration<double, std::nano> duration{ std::chrono::steady_clock::now() - start };
+
+		std::cout << "Material benchmark " << name << ": " << pMaterial->GetSizeInBytes() / (1024.f * 1024.f) << " MB, "
+			<< duration.count() / (nrRepeats * nrRows * nrBatchesPerRow * 8) << " ns/sample (" << sum << ")" << std::endl;
+
+		delete pMaterial;
+	}
+}
+
+//which implementation every hot kernel picked
+void PrintSimdKernels(const Renderer* pRenderer)
+{
+	std::cout << "SIMD: cpu supports " << GetSimdLevelName(GetSupportedSimdLevel()) << ", running " << GetSimdLevelName(GetSimdLevel())
+		<< " (matrix transforms " << GetSimdLevelName(Matrix::GetTransformSimdLevel())
+		<< ", raster + shading + color packing " << GetSimdLevelName(pRenderer->GetRasterSimdLevel())
+		<< ", texture sampling " << GetSimdLevelName(Texture::GetSampleSimdLevel()) << ")" << std::endl;
+}
+
 int main(int argc, char* args[])
 {
-	//Unreferenced parameters
-	(void)argc;
-	(void)args;
+	//--benchmark: time every raster mode and quit
+	//--simd=<scalar|sse4|avx2|avx512>: run the kernels of a lower instruction set than the cpu supports
+	bool runBenchmark{ false };
+	for (int i{ 1 }; i < argc; ++i)
+	{
+		const std::string arg{ args[i] };
+		if (arg == "--benchmark")
+			runBenchmark = true;
+		else if (arg.starts_with("--simd=") && !SetSimdLevel(std::string_view{ arg }.substr(7)))
+			std::cout << "Unknown simd level " << arg.substr(7) << ", keeping " << GetSimdLevelName(GetSimdLevel()) << std::endl;
+	}
 
 	//Create window + surfaces
 	SDL_Init(SDL_INIT_VIDEO);
@@ -43,15 +256,21 @@ int main(int argc, char* args[])
 	//Initialize "framework"
 	const auto pTimer = new Timer();
 	const auto pRenderer = new Renderer(pWindow);
+	PrintSimdKernels(pRenderer);
 
 	//Start loop
 	pTimer->Start();
 
 	// Start Benchmark
-	// TODO pTimer->StartBenchmark();
+	if (runBenchmark)
+	{
+		RunBenchmark(pRenderer, pTimer);
+		RunTextureBenchmark();
+		RunMaterialBenchmark();
+	}
 
 	float printTimer = 0.f;
-	bool isLooping = true;
+	bool isLooping = !runBenchmark;
 	bool takeScreenshot = false;
 	while (isLooping)
 	{
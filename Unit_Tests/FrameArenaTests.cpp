@@ -0,0 +1,140 @@
+#include "gtest/gtest.h"
+#include "FrameArena.h"
+
+#include <cstdint>
+#include <numeric>
+
+
+namespace dae
+{
+	namespace
+	{
+		bool IsAligned(const void* pointer, size_t alignment)
+		{
+			return reinterpret_cast<uintptr_t>(pointer) % alignment == 0;
+		}
+
+		//a frame of allocations with mixed sizes and alignments, returns the first one
+		void* AllocateFrame(FrameArena& arena)
+		{
+			void* pFirst{ arena.Allocate(100, 16) };
+			arena.Allocate(1, 1);
+			arena.Allocate(3000, 64);
+			arena.Allocate<double>(17);
+			arena.Allocate(5, 8);
+			return pFirst;
+		}
+	}
+
+	TEST(FrameArena, CapacityIsRoundedToCacheLines)
+	{
+		EXPECT_EQ(FrameArena{}.GetCapacity(), 0u);
+		EXPECT_EQ(FrameArena{ 1 }.GetCapacity(), 64u);
+		EXPECT_EQ(FrameArena{ 64 }.GetCapacity(), 64u);
+		EXPECT_EQ(FrameArena{ 1000 }.GetCapacity(), 1024u);
+	}
+
+	TEST(FrameArena, AllocationsAreAlignedAndDisjoint)
+	{
+		FrameArena arena{ 4096 };
+
+		std::byte* pPrevious{};
+		size_t previousSize{};
+		for (size_t alignment{ 1 }; alignment <= 64; alignment *= 2)
+		{
+			std::byte* pAllocation{ static_cast<std::byte*>(arena.Allocate(alignment + 3, alignment)) };
+			EXPECT_TRUE(IsAligned(pAllocation, alignment)) << "alignment " << alignment;
+			if (pPrevious) EXPECT_GE(pAllocation, pPrevious + previousSize);
+
+			pPrevious = pAllocation;
+			previousSize = alignment + 3;
+		}
+		EXPECT_LE(arena.GetSize(), arena.GetCapacity());
+	}
+
+	TEST(FrameArena, ResetRewinds)
+	{
+		FrameArena arena{ 8192 };
+
+		void* pFirst{ AllocateFrame(arena) };
+		const size_t frameSize{ arena.GetSize() };
+		EXPECT_GT(frameSize, 0u);
+
+		arena.Reset();
+		EXPECT_EQ(arena.GetSize(), 0u);
+		EXPECT_EQ(arena.GetCapacity(), 8192u);
+
+		//the same frame again lands on the same memory
+		EXPECT_EQ(AllocateFrame(arena), pFirst);
+		EXPECT_EQ(arena.GetSize(), frameSize);
+	}
+
+	TEST(FrameArena, OverflowGrowsToThePeakOnReset)
+	{
+		//starts empty, so the whole first frame goes to overflow blocks
+		FrameArena arena{};
+		void* pOverflow{ AllocateFrame(arena) };
+		EXPECT_TRUE(IsAligned(pOverflow, 16));
+		const size_t peakSize{ arena.GetSize() };
+		EXPECT_GT(peakSize, 0u);
+		EXPECT_EQ(arena.GetCapacity(), 0u);
+
+		arena.Reset();
+		EXPECT_GE(arena.GetCapacity(), peakSize);
+		EXPECT_EQ(arena.GetCapacity() % 64, 0u);
+		EXPECT_EQ(arena.GetSize(), 0u);
+
+		//the same frame fits now, the capacity stays put from here on
+		const size_t capacity{ arena.GetCapacity() };
+		for (int frameIdx{}; frameIdx < 3; ++frameIdx)
+		{
+			void* pFirst{ AllocateFrame(arena) };
+			EXPECT_LE(arena.GetSize(), capacity);
+			arena.Reset();
+			EXPECT_EQ(arena.GetCapacity(), capacity);
+			EXPECT_EQ(AllocateFrame(arena), pFirst);
+			arena.Reset();
+		}
+	}
+
+	TEST(FrameArena, OverflowInTheMiddleOfAFrame)
+	{
+		FrameArena arena{ 256 };
+
+		int* pFits{ arena.Allocate<int>(32) };
+		//doesn't fit, but has to be usable and keep the earlier allocation intact
+		int* pOverflow{ arena.Allocate<int>(1000) };
+		std::iota(pFits, pFits + 32, 0);
+		std::iota(pOverflow, pOverflow + 1000, 100);
+		EXPECT_EQ(pFits[31], 31);
+		EXPECT_EQ(pOverflow[999], 1099);
+		EXPECT_EQ(arena.GetCapacity(), 256u);
+
+		arena.Reset();
+		EXPECT_GE(arena.GetCapacity(), sizeof(int) * 1032);
+
+		arena.Allocate<int>(32);
+		arena.Allocate<int>(1000);
+		EXPECT_LE(arena.GetSize(), arena.GetCapacity());
+	}
+
+	TEST(FrameArena, ArenaVectorGrows)
+	{
+		FrameArena arena{ 1024 };
+
+		//outgrows the arena while pushing, the old buffers are simply left behind until Reset
+		ArenaVector<int> values{ arena };
+		for (int value{}; value < 5000; ++value)
+		{
+			values.push_back(value);
+		}
+		for (int value{}; value < 5000; ++value)
+		{
+			ASSERT_EQ(values[value], value);
+		}
+
+		values = ArenaVector<int>{ arena };
+		arena.Reset();
+		EXPECT_GE(arena.GetCapacity(), sizeof(int) * 5000);
+	}
+}
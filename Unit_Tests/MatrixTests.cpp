@@ -0,0 +1,174 @@
+#include "gtest/gtest.h"
+#include "CpuFeatures.h"
+#include "Matrix.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+namespace dae
+{
+	namespace
+	{
+		constexpr SimdLevel simdLevels[]{ SimdLevel::scalar, SimdLevel::sse4, SimdLevel::avx2, SimdLevel::avx512 };
+
+		//restores the simd level when a test ends, SetSimdLevel is process wide
+		struct SimdLevelScope
+		{
+			SimdLevel level{ GetSimdLevel() };
+			~SimdLevelScope() { SetSimdLevel(level); }
+		};
+
+		//a perspective projection times a rotated, scaled and translated world matrix, so w is not 1
+		Matrix CreateWorldViewProjection()
+		{
+			const Matrix world{ Matrix::CreateScale(1.5f, .75f, 2.f) * Matrix::CreateRotation(.3f, 1.1f, -.4f) * Matrix::CreateTranslation(3.f, -2.f, 25.f) };
+			return world * Matrix::CreatePerspectiveFovLH(.8f, 4.f / 3.f, 1.f, 100.f);
+		}
+
+		std::vector<Vector3> CreateRandomVectors(size_t count, uint32_t seed)
+		{
+			std::mt19937 random{ seed };
+			std::uniform_real_distribution<float> distribution{ -10.f, 10.f };
+			std::vector<Vector3> vectors(count);
+			for (Vector3& vector : vectors)
+			{
+				vector = { distribution(random), distribution(random), distribution(random) };
+			}
+			return vectors;
+		}
+
+		//bit for bit, Vector4::operator== has a tolerance
+		void ExpectSame(const Vector4& actual, const Vector4& expected, size_t idx)
+		{
+			EXPECT_EQ(actual.x, expected.x) << "element " << idx;
+			EXPECT_EQ(actual.y, expected.y) << "element " << idx;
+			EXPECT_EQ(actual.z, expected.z) << "element " << idx;
+			EXPECT_EQ(actual.w, expected.w) << "element " << idx;
+		}
+
+		void ExpectSame(const Vector3& actual, const Vector3& expected, size_t idx)
+		{
+			EXPECT_EQ(actual.x, expected.x) << "element " << idx;
+			EXPECT_EQ(actual.y, expected.y) << "element " << idx;
+			EXPECT_EQ(actual.z, expected.z) << "element " << idx;
+		}
+
+		void ExpectSame(const Matrix& actual, const Matrix& expected)
+		{
+			for (int rowIdx{}; rowIdx < 4; ++rowIdx)
+			{
+				ExpectSame(actual[rowIdx], expected[rowIdx], rowIdx);
+			}
+		}
+	}
+
+	TEST(Matrix, TransformPointsMatchesTransformPointAtEverySimdLevel)
+	{
+		const SimdLevelScope simdLevelScope{};
+		const Matrix matrix{ CreateWorldViewProjection() };
+		//every remainder of the 1, 2, 4 and 8 wide loops
+		const std::vector<Vector3> points{ CreateRandomVectors(37, 7) };
+
+		for (const SimdLevel simdLevel : simdLevels)
+		{
+			if (simdLevel > GetSupportedSimdLevel()) continue;
+			SetSimdLevel(simdLevel);
+
+			for (const bool perspectiveDivide : { false, true })
+			{
+				SCOPED_TRACE(std::string{ GetSimdLevelName(simdLevel) } + (perspectiveDivide ? ", perspective divide" : ""));
+				for (size_t count{}; count <= points.size(); ++count)
+				{
+					std::vector<Vector4> out(count);
+					matrix.TransformPoints(std::span{ points }.first(count), out, perspectiveDivide);
+
+					for (size_t i{}; i < count; ++i)
+					{
+						Vector4 expected{ matrix.TransformPoint(Vector4{ points[i], 1.f }) };
+						if (perspectiveDivide)
+						{
+							expected.x /= expected.w;
+							expected.y /= expected.w;
+							expected.z /= expected.w;
+						}
+						ExpectSame(out[i], expected, i);
+					}
+				}
+			}
+		}
+	}
+
+	TEST(Matrix, TransformVectorsMatchesTransformVectorAtEverySimdLevel)
+	{
+		const SimdLevelScope simdLevelScope{};
+		const Matrix matrix{ CreateWorldViewProjection() };
+		const std::vector<Vector3> vectors{ CreateRandomVectors(13, 9) };
+
+		for (const SimdLevel simdLevel : simdLevels)
+		{
+			if (simdLevel > GetSupportedSimdLevel()) continue;
+			SetSimdLevel(simdLevel);
+			SCOPED_TRACE(GetSimdLevelName(simdLevel));
+
+			for (size_t count{}; count <= vectors.size(); ++count)
+			{
+				const std::span<const Vector3> in{ std::span{ vectors }.first(count) };
+
+				//one past the end is never written
+				std::vector<Vector3> out(count + 1, Vector3{ 1.f, 2.f, 3.f });
+				matrix.TransformVectors(in, std::span{ out }.first(count));
+				ExpectSame(out[count], Vector3{ 1.f, 2.f, 3.f }, count);
+
+				//in place
+				std::vector<Vector3> inPlace(in.begin(), in.end());
+				matrix.TransformVectors(inPlace, inPlace);
+
+				for (size_t i{}; i < count; ++i)
+				{
+					const Vector3 expected{ matrix.TransformVector(vectors[i]) };
+					ExpectSame(out[i], expected, i);
+					ExpectSame(inPlace[i], expected, i);
+				}
+			}
+		}
+	}
+
+	TEST(Matrix, MultiplyAndInverseMatchTheScalarCodeAtEverySimdLevel)
+	{
+		const SimdLevelScope simdLevelScope{};
+		const Matrix a{ CreateWorldViewProjection() };
+		const Matrix b{ Matrix::CreateRotation(-.7f, .2f, 1.3f) * Matrix::CreateTranslation(-4.f, 8.f, .5f) };
+
+		SetSimdLevel(SimdLevel::scalar);
+		const Matrix expectedProduct{ a * b };
+		const Matrix expectedInverse{ Matrix::Inverse(a) };
+		const Matrix expectedWorldInverse{ Matrix::Inverse(b) };
+
+		for (const SimdLevel simdLevel : simdLevels)
+		{
+			if (simdLevel > GetSupportedSimdLevel()) continue;
+			SetSimdLevel(simdLevel);
+			SCOPED_TRACE(GetSimdLevelName(simdLevel));
+
+			ExpectSame(a * b, expectedProduct);
+			Matrix product{ a };
+			product *= b;
+			ExpectSame(product, expectedProduct);
+
+			ExpectSame(Matrix::Inverse(a), expectedInverse);
+			ExpectSame(Matrix::Inverse(b), expectedWorldInverse);
+		}
+
+		//and the inverse is one: b * inverse(b) is the identity, up to rounding
+		//(only for affine matrices, the w column of the inverse is always 0 0 0 1)
+		const Matrix identity{ b * expectedWorldInverse };
+		for (int rowIdx{}; rowIdx < 4; ++rowIdx)
+		{
+			for (int columnIdx{}; columnIdx < 4; ++columnIdx)
+			{
+				EXPECT_NEAR(identity[rowIdx][columnIdx], rowIdx == columnIdx ? 1.f : 0.f, 1e-4f) << rowIdx << ", " << columnIdx;
+			}
+		}
+	}
+}
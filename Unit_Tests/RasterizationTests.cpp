@@ -0,0 +1,264 @@
+#include "gtest/gtest.h"
+#include "Rasterization.h"
+#include "Vector4.h"
+
+#include <cmath>
+#include <utility>
+#include <vector>
+
+
+namespace dae
+{
+	namespace
+	{
+		struct ScreenPoint
+		{
+			float x{};
+			float y{};
+		};
+
+		//the same edge setup as the renderer: snapped vertices, edge i opposite vertex i, turned front facing
+		struct Triangle
+		{
+			EdgeFunction edges[3]{};
+
+			Triangle(ScreenPoint v0, ScreenPoint v1, ScreenPoint v2)
+			{
+				int64_t x[3]{ std::llround(v0.x * subPixelOne), std::llround(v1.x * subPixelOne), std::llround(v2.x * subPixelOne) };
+				int64_t y[3]{ std::llround(v0.y * subPixelOne), std::llround(v1.y * subPixelOne), std::llround(v2.y * subPixelOne) };
+				if ((x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]) < 0)
+				{
+					std::swap(x[1], x[2]);
+					std::swap(y[1], y[2]);
+				}
+
+				edges[0] = SetupEdgeFunction(x[1], y[1], x[2], y[2]);
+				edges[1] = SetupEdgeFunction(x[2], y[2], x[0], y[0]);
+				edges[2] = SetupEdgeFunction(x[0], y[0], x[1], y[1]);
+			}
+
+			bool Covers(int px, int py) const
+			{
+				return edges[0].Evaluate(px, py) >= 0 && edges[1].Evaluate(px, py) >= 0 && edges[2].Evaluate(px, py) >= 0;
+			}
+		};
+	}
+
+	TEST(FillRule, PixelCentersOnEdgesBelongToTopAndLeftEdges)
+	{
+		//corners on pixel centers, so whole rows and columns of centers lie exactly on the edges
+		const ScreenPoint topLeft{ .5f, .5f };
+		const ScreenPoint topRight{ 4.5f, .5f };
+		const ScreenPoint bottomLeft{ .5f, 4.5f };
+		const ScreenPoint bottomRight{ 4.5f, 4.5f };
+
+		const Triangle upper{ topLeft, topRight, bottomRight };
+		const Triangle lower{ topLeft, bottomRight, bottomLeft };
+
+		for (int py{ -1 }; py < 7; ++py)
+		{
+			for (int px{ -1 }; px < 7; ++px)
+			{
+				const int nrCovering{ static_cast<int>(upper.Covers(px, py)) + static_cast<int>(lower.Covers(px, py)) };
+
+				//top and left edge in, bottom and right edge out, the shared diagonal exactly once
+				const bool isInside{ px >= 0 && px < 4 && py >= 0 && py < 4 };
+				EXPECT_EQ(nrCovering, isInside ? 1 : 0) << "pixel " << px << ", " << py;
+			}
+		}
+	}
+
+	TEST(FillRule, HorizontalEdges)
+	{
+		//flat top and flat bottom triangle, the centers of row 2 lie on both horizontal edges
+		const Triangle flatTop{ { 0.f, 2.5f }, { 8.f, 2.5f }, { 4.f, 6.f } };
+		const Triangle flatBottom{ { 4.f, -1.f }, { 0.f, 2.5f }, { 8.f, 2.5f } };
+
+		EXPECT_TRUE(flatTop.Covers(4, 2));
+		EXPECT_FALSE(flatBottom.Covers(4, 2));
+		EXPECT_TRUE(flatBottom.Covers(4, 1));
+	}
+
+	TEST(FillRule, SharedEdgesOfAMeshCoverEveryPixelOnce)
+	{
+		//a grid of quads with jittered corners, every interior pixel has to be drawn by exactly one triangle
+		constexpr int nrCells{ 6 };
+		constexpr float cellSize{ 5.f };
+		constexpr int nrPixels{ static_cast<int>(nrCells * cellSize) };
+
+		//corners on pixel centers, on sub-pixel steps and on odd fractions, the border stays straight
+		std::vector<ScreenPoint> corners{};
+		for (int y{}; y <= nrCells; ++y)
+		{
+			for (int x{}; x <= nrCells; ++x)
+			{
+				const bool isBorder{ x == 0 || y == 0 || x == nrCells || y == nrCells };
+				const float jitterX{ isBorder ? 0.f : static_cast<float>((x * 7 + y * 3) % 5) * .5f - 1.f + static_cast<float>(y % 3) / subPixelOne };
+				const float jitterY{ isBorder ? 0.f : static_cast<float>((x * 5 + y * 11) % 5) * .5f - 1.f };
+				corners.push_back({ x * cellSize + jitterX, y * cellSize + jitterY });
+			}
+		}
+
+		std::vector<Triangle> triangles{};
+		for (int y{}; y < nrCells; ++y)
+		{
+			for (int x{}; x < nrCells; ++x)
+			{
+				const ScreenPoint& topLeft{ corners[x + y * (nrCells + 1)] };
+				const ScreenPoint& topRight{ corners[x + 1 + y * (nrCells + 1)] };
+				const ScreenPoint& bottomLeft{ corners[x + (y + 1) * (nrCells + 1)] };
+				const ScreenPoint& bottomRight{ corners[x + 1 + (y + 1) * (nrCells + 1)] };
+
+				//alternate the diagonal so both directions are shared
+				if ((x + y) % 2 == 0)
+				{
+					triangles.emplace_back(topLeft, topRight, bottomRight);
+					triangles.emplace_back(topLeft, bottomRight, bottomLeft);
+				}
+				else
+				{
+					triangles.emplace_back(topLeft, topRight, bottomLeft);
+					triangles.emplace_back(topRight, bottomRight, bottomLeft);
+				}
+			}
+		}
+
+		for (int py{}; py < nrPixels; ++py)
+		{
+			for (int px{}; px < nrPixels; ++px)
+			{
+				int nrCovering{};
+				for (const Triangle& triangle : triangles)
+				{
+					nrCovering += static_cast<int>(triangle.Covers(px, py));
+				}
+				EXPECT_EQ(nrCovering, 1) << "pixel " << px << ", " << py;
+			}
+		}
+	}
+
+	namespace
+	{
+		//attributes that are a linear function of the clip position, lerping them has to keep them on it
+		float LinearAttribute(const Vector4& position)
+		{
+			return position.x * 2.f - position.y + position.z * 3.f + position.w * .5f;
+		}
+
+		float LerpAttribute(float attribute0, float attribute1, float t)
+		{
+			return attribute0 + (attribute1 - attribute0) * t;
+		}
+
+		int ClipTriangle(const Vector4& v0, const Vector4& v1, const Vector4& v2, Vector4 (&polygon)[maxClippedVertices], float (&attributes)[maxClippedVertices])
+		{
+			polygon[0] = v0;
+			polygon[1] = v1;
+			polygon[2] = v2;
+			for (int vertexIdx{}; vertexIdx < 3; ++vertexIdx)
+			{
+				attributes[vertexIdx] = LinearAttribute(polygon[vertexIdx]);
+			}
+
+			const uint32_t crossedPlanes{ ComputeOutcode(v0) | ComputeOutcode(v1) | ComputeOutcode(v2) };
+			return ClipPolygon(polygon, attributes, 3, crossedPlanes & clippingPlanes, LerpAttribute);
+		}
+
+		void ExpectInsideClippingPlanes(const Vector4* polygon, const float* attributes, int nrVertices)
+		{
+			for (int vertexIdx{}; vertexIdx < nrVertices; ++vertexIdx)
+			{
+				for (int planeIdx{}; planeIdx < nrClipSpacePlanes; ++planeIdx)
+				{
+					if (!(clippingPlanes & (1u << planeIdx))) continue;
+					EXPECT_GE(Vector4::Dot(clipSpacePlanes[planeIdx], polygon[vertexIdx]), -1e-4f) << "vertex " << vertexIdx << ", plane " << planeIdx;
+				}
+				EXPECT_NEAR(attributes[vertexIdx], LinearAttribute(polygon[vertexIdx]), 1e-4f) << "vertex " << vertexIdx;
+			}
+		}
+
+		void ExpectVector4Near(const Vector4& actual, const Vector4& expected)
+		{
+			EXPECT_NEAR(actual.x, expected.x, 1e-6f);
+			EXPECT_NEAR(actual.y, expected.y, 1e-6f);
+			EXPECT_NEAR(actual.z, expected.z, 1e-6f);
+			EXPECT_NEAR(actual.w, expected.w, 1e-6f);
+		}
+	}
+
+	TEST(Clipper, Outcodes)
+	{
+		EXPECT_EQ(ComputeOutcode({ 0.f, 0.f, .5f, 1.f }), 0u);
+		//left of the screen but inside the guard band
+		EXPECT_EQ(ComputeOutcode({ -2.f, 0.f, .5f, 1.f }), 1u << 0);
+		//behind the near plane
+		EXPECT_EQ(ComputeOutcode({ 0.f, 0.f, -.1f, 1.f }), 1u << 4);
+		//beyond the far plane
+		EXPECT_EQ(ComputeOutcode({ 0.f, 0.f, 1.5f, 1.f }), 1u << 5);
+		//right of the guard band
+		EXPECT_EQ(ComputeOutcode({ 20.f, 0.f, .5f, 1.f }), (1u << 1) | (1u << 7));
+	}
+
+	TEST(Clipper, NearPlaneCutsOffOneCorner)
+	{
+		Vector4 polygon[maxClippedVertices]{};
+		float attributes[maxClippedVertices]{};
+		const int nrVertices{ ClipTriangle({ 0.f, 0.f, -1.f, 1.f }, { 1.f, 0.f, 1.f, 1.f }, { 0.f, 1.f, 1.f, 1.f }, polygon, attributes) };
+
+		//the corner behind the near plane turns into two vertices on it, in the winding of the triangle
+		ASSERT_EQ(nrVertices, 4);
+		ExpectVector4Near(polygon[0], { .5f, 0.f, 0.f, 1.f });
+		ExpectVector4Near(polygon[1], { 1.f, 0.f, 1.f, 1.f });
+		ExpectVector4Near(polygon[2], { 0.f, 1.f, 1.f, 1.f });
+		ExpectVector4Near(polygon[3], { 0.f, .5f, 0.f, 1.f });
+		ExpectInsideClippingPlanes(polygon, attributes, nrVertices);
+	}
+
+	TEST(Clipper, NearAndFarPlane)
+	{
+		Vector4 polygon[maxClippedVertices]{};
+		float attributes[maxClippedVertices]{};
+		//spans from behind the camera to beyond the far plane, with perspective w
+		const int nrVertices{ ClipTriangle({ 0.f, 0.f, -2.f, .5f }, { 1.f, 0.f, 4.f, 3.f }, { 0.f, 1.f, 4.f, 2.f }, polygon, attributes) };
+
+		ASSERT_GE(nrVertices, 3);
+		ASSERT_LE(nrVertices, maxClippedVertices);
+		ExpectInsideClippingPlanes(polygon, attributes, nrVertices);
+	}
+
+	TEST(Clipper, GuardBand)
+	{
+		Vector4 polygon[maxClippedVertices]{};
+		float attributes[maxClippedVertices]{};
+		//far outside the guard band on three sides
+		const int nrVertices{ ClipTriangle({ -100.f, -100.f, .5f, 1.f }, { 100.f, -100.f, .5f, 1.f }, { 0.f, 100.f, .5f, 1.f }, polygon, attributes) };
+
+		ASSERT_GE(nrVertices, 3);
+		ExpectInsideClippingPlanes(polygon, attributes, nrVertices);
+	}
+
+	TEST(Clipper, EverythingBehindTheNearPlane)
+	{
+		Vector4 polygon[maxClippedVertices]{ { 0.f, 0.f, -1.f, 1.f }, { 1.f, 0.f, -1.f, 1.f }, { 0.f, 1.f, -2.f, 1.f } };
+		float attributes[maxClippedVertices]{};
+
+		EXPECT_LT(ClipPolygon(polygon, attributes, 3, clippingPlanes, LerpAttribute), 3);
+	}
+
+	TEST(Clipper, VertexOnThePlaneIsNotDuplicated)
+	{
+		Vector4 polygon[maxClippedVertices]{};
+		float attributes[maxClippedVertices]{};
+		//one corner exactly on the near plane, one behind it
+		const int nrVertices{ ClipTriangle({ 0.f, 0.f, 0.f, 1.f }, { 1.f, 0.f, -1.f, 1.f }, { 0.f, 1.f, 1.f, 1.f }, polygon, attributes) };
+
+		ASSERT_EQ(nrVertices, 3);
+		for (int vertexIdx{}; vertexIdx < nrVertices; ++vertexIdx)
+		{
+			const Vector4& vertex{ polygon[vertexIdx] };
+			const Vector4& next{ polygon[(vertexIdx + 1) % nrVertices] };
+			EXPECT_TRUE(vertex.x != next.x || vertex.y != next.y || vertex.z != next.z || vertex.w != next.w) << "vertex " << vertexIdx;
+		}
+		ExpectInsideClippingPlanes(polygon, attributes, nrVertices);
+	}
+}
@@ -0,0 +1,413 @@
+#include "gtest/gtest.h"
+#include "CpuFeatures.h"
+#include "Texture.h"
+#include "Vector2.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace dae
+{
+	namespace
+	{
+		//row-major RGBA8 maps of one material, red in the lowest byte
+		struct MaterialMaps
+		{
+			int width{};
+			int height{};
+			std::vector<uint32_t> diffuse;
+			std::vector<uint32_t> normal;
+			std::vector<uint32_t> specular;
+			std::vector<uint32_t> glossiness;
+
+			MaterialMaps(int width, int height)
+				: width{ width }
+				, height{ height }
+				, diffuse(width * height)
+				, normal(width * height)
+				, specular(width * height)
+				, glossiness(width * height)
+			{
+			}
+
+			std::unique_ptr<Texture> Create(Texture::MaterialFormat format, Texture::TexelLayout layout = Texture::TexelLayout::rowMajor) const
+			{
+				return std::unique_ptr<Texture>{ Texture::CreateMaterial(width, height, diffuse.data(), normal.data(), specular.data(), glossiness.data(), nullptr, layout, format) };
+			}
+		};
+
+		uint32_t PackRGB(uint32_t red, uint32_t green, uint32_t blue)
+		{
+			return red | (green << 8) | (blue << 16);
+		}
+
+		//noise in every channel of every map, the worst case for the block encoders
+		MaterialMaps CreateNoiseMaps(int width, int height, uint32_t seed)
+		{
+			MaterialMaps maps{ width, height };
+			std::mt19937 random{ seed };
+			for (int texelIdx{}; texelIdx < width * height; ++texelIdx)
+			{
+				maps.diffuse[texelIdx] = random();
+				maps.normal[texelIdx] = random();
+				maps.specular[texelIdx] = random();
+				maps.glossiness[texelIdx] = random();
+			}
+			return maps;
+		}
+
+		//GetNearestTexel rounds size * uv + .5, so this uv lands inside texel x
+		float GetTexelUv(int x, int size)
+		{
+			return (static_cast<float>(x) - .25f) / static_cast<float>(size);
+		}
+
+		//the uvLod that picks mipLevel
+		float GetUvLod(const Texture& texture, int mipLevel)
+		{
+			return static_cast<float>(mipLevel) - .5f * std::log2(static_cast<float>(texture.GetWidth()) * static_cast<float>(texture.GetHeight()));
+		}
+
+		//the 8-bit channels of a sample, as stored
+		struct MaterialTexel
+		{
+			int channels[7]{};	//diffuse RGB, specular, normal XY, glossiness
+		};
+
+		int ToByte(float unorm)
+		{
+			return static_cast<int>(std::lround(unorm * 255.f));
+		}
+
+		MaterialTexel ToTexel(const Texture::MaterialSample& material)
+		{
+			return { { ToByte(material.diffuse.r), ToByte(material.diffuse.g), ToByte(material.diffuse.b), ToByte(material.specular),
+				ToByte(.5f * material.normal.x + .5f), ToByte(.5f * material.normal.y + .5f), ToByte(material.glossiness) } };
+		}
+
+		MaterialTexel SampleTexel(const Texture& texture, int x, int y, int mipLevel, int levelWidth, int levelHeight)
+		{
+			return ToTexel(texture.SampleMaterial(Vector2{ GetTexelUv(x, levelWidth), GetTexelUv(y, levelHeight) }, GetUvLod(texture, mipLevel)));
+		}
+
+		//square levels
+		MaterialTexel SampleTexel(const Texture& texture, int x, int y, int mipLevel, int levelSize)
+		{
+			return SampleTexel(texture, x, y, mipLevel, levelSize, levelSize);
+		}
+
+		void ExpectSameLanes(const Texture::MaterialBatch& batch, const Texture::MaterialBatch& expected, uint32_t laneMask)
+		{
+			for (int lane{}; lane < 8; ++lane)
+			{
+				if (!(laneMask & (1u << lane))) continue;
+				for (int channel{}; channel < 3; ++channel)
+				{
+					EXPECT_EQ(batch.diffuse[channel][lane], expected.diffuse[channel][lane]) << "lane " << lane;
+					EXPECT_EQ(batch.normal[channel][lane], expected.normal[channel][lane]) << "lane " << lane;
+				}
+				EXPECT_EQ(batch.specular[lane], expected.specular[lane]) << "lane " << lane;
+				EXPECT_EQ(batch.glossiness[lane], expected.glossiness[lane]) << "lane " << lane;
+			}
+		}
+
+		//restores the simd level when a test ends, SetSimdLevel is process wide
+		struct SimdLevelScope
+		{
+			SimdLevel level{ GetSimdLevel() };
+			~SimdLevelScope() { SetSimdLevel(level); }
+		};
+	}
+
+	TEST(Texture, OddMipLevelsKeepTheirLastColumnAndRow)
+	{
+		//5x3 -> 3x2 -> 2x1 -> 1x1: sizes round up, the texels past an odd edge repeat the edge
+		//every texel has its own diffuse red, so the averages show which texels were used
+		MaterialMaps maps{ 5, 3 };
+		for (int texelIdx{}; texelIdx < 15; ++texelIdx)
+		{
+			maps.diffuse[texelIdx] = PackRGB(texelIdx * 16, 0, 0);
+		}
+		const std::unique_ptr<Texture> pMaterial{ maps.Create(Texture::MaterialFormat::uncompressed) };
+		ASSERT_EQ(pMaterial->GetNrMipLevels(), 4);
+
+		//rounded averages of the red values
+		//  0  16  32  48  64
+		// 80  96 112 128 144
+		//160 176 192 208 224
+		const int level1[2][3]
+		{
+			{ 48, 80, 104 },	//(0 + 16 + 80 + 96) / 4, ..., (64 + 64 + 144 + 144) / 4
+			{ 168, 200, 224 }	//(160 + 176 + 160 + 176) / 4, ..., the corner texel 4 times
+		};
+		for (int y{}; y < 2; ++y)
+		{
+			for (int x{}; x < 3; ++x)
+			{
+				EXPECT_EQ(SampleTexel(*pMaterial, x, y, 1, 3, 2).channels[0], level1[y][x]) << "level 1, texel " << x << ", " << y;
+			}
+		}
+
+		//(48 + 80 + 168 + 200) / 4, (104 + 104 + 224 + 224) / 4
+		EXPECT_EQ(SampleTexel(*pMaterial, 0, 0, 2, 2, 1).channels[0], 124);
+		EXPECT_EQ(SampleTexel(*pMaterial, 1, 0, 2, 2, 1).channels[0], 164);
+		//(124 + 164 + 124 + 164 + 2) / 4
+		EXPECT_EQ(SampleTexel(*pMaterial, 0, 0, 3, 1, 1).channels[0], 144);
+	}
+
+	TEST(BlockCompression, EndpointsExpandBy565BitReplication)
+	{
+		//one uniform 4x4 block per 6-bit value: the block is stored as 2 equal endpoints
+		//red and blue take the 5-bit value (clamped), green the 6-bit one
+		MaterialMaps maps{ 64 * 4, 4 };
+		for (int y{}; y < maps.height; ++y)
+		{
+			for (int x{}; x < maps.width; ++x)
+			{
+				const uint32_t value6{ static_cast<uint32_t>(x / 4) };
+				const uint32_t value5{ std::min(value6, 31u) };
+				const uint32_t red{ (value5 << 3) | (value5 >> 2) };
+				const uint32_t green{ (value6 << 2) | (value6 >> 4) };
+				const uint32_t blue{ ((31 - value5) << 3) | ((31 - value5) >> 2) };
+				maps.diffuse[y * maps.width + x] = PackRGB(red, green, blue);
+			}
+		}
+		const std::unique_ptr<Texture> pCompressed{ maps.Create(Texture::MaterialFormat::compressed) };
+
+		for (int value6{}; value6 < 64; ++value6)
+		{
+			const int value5{ std::min(value6, 31) };
+			const MaterialTexel texel{ SampleTexel(*pCompressed, value6 * 4 + 1, 2, 0, maps.width) };
+			//bit replication is exactly what the encoder quantizes back from
+			EXPECT_EQ(texel.channels[0], (value5 << 3) | (value5 >> 2)) << "5-bit " << value5;
+			EXPECT_EQ(texel.channels[1], (value6 << 2) | (value6 >> 4)) << "6-bit " << value6;
+			EXPECT_EQ(texel.channels[2], ((31 - value5) << 3) | ((31 - value5) >> 2)) << "5-bit " << 31 - value5;
+		}
+
+		//the ends of the range are exact
+		EXPECT_EQ(SampleTexel(*pCompressed, 1, 1, 0, maps.width).channels[0], 0);
+		EXPECT_EQ(SampleTexel(*pCompressed, 1, 1, 0, maps.width).channels[1], 0);
+		EXPECT_EQ(SampleTexel(*pCompressed, 1, 1, 0, maps.width).channels[2], 255);
+		EXPECT_EQ(SampleTexel(*pCompressed, 63 * 4 + 1, 1, 0, maps.width).channels[0], 255);
+		EXPECT_EQ(SampleTexel(*pCompressed, 63 * 4 + 1, 1, 0, maps.width).channels[1], 255);
+		EXPECT_EQ(SampleTexel(*pCompressed, 63 * 4 + 1, 1, 0, maps.width).channels[2], 0);
+	}
+
+	TEST(BlockCompression, UniformBlocksRoundToNearest565)
+	{
+		//one uniform block per 8-bit value: only the 565 quantization is lost, at most half a step
+		MaterialMaps maps{ 256 * 4, 4 };
+		for (int y{}; y < maps.height; ++y)
+		{
+			for (int x{}; x < maps.width; ++x)
+			{
+				const uint32_t value{ static_cast<uint32_t>(x / 4) };
+				maps.diffuse[y * maps.width + x] = PackRGB(value, value, 255 - value);
+				maps.specular[y * maps.width + x] = value;
+				maps.normal[y * maps.width + x] = PackRGB(value, 255 - value, 0);
+				maps.glossiness[y * maps.width + x] = value;
+			}
+		}
+		const std::unique_ptr<Texture> pCompressed{ maps.Create(Texture::MaterialFormat::compressed) };
+
+		for (int value{}; value < 256; ++value)
+		{
+			const MaterialTexel texel{ SampleTexel(*pCompressed, value * 4 + 2, 3, 0, maps.width) };
+			//half of 255 / 31 and 255 / 63, plus the bit replication being off by up to one
+			EXPECT_LE(std::abs(texel.channels[0] - value), 5) << value;
+			EXPECT_LE(std::abs(texel.channels[1] - value), 3) << value;
+			EXPECT_LE(std::abs(texel.channels[2] - (255 - value)), 5) << value;
+			//the BC4 endpoints are 8-bit, uniform blocks are exact
+			EXPECT_EQ(texel.channels[3], value);
+			EXPECT_EQ(texel.channels[4], value);
+			EXPECT_EQ(texel.channels[5], 255 - value);
+			EXPECT_EQ(texel.channels[6], value);
+		}
+	}
+
+	TEST(BlockCompression, Bc4RoundTripErrorIsBoundedByThePalette)
+	{
+		//8 palette entries span the block's range in 7 steps: every texel is at most half a step (+ rounding) away
+		//checked on every mip level against the uncompressed material, which holds the exact source of each level
+		const MaterialMaps maps{ CreateNoiseMaps(64, 64, 17) };
+		const std::unique_ptr<Texture> pUncompressed{ maps.Create(Texture::MaterialFormat::uncompressed) };
+		const std::unique_ptr<Texture> pCompressed{ maps.Create(Texture::MaterialFormat::compressed) };
+		ASSERT_EQ(pCompressed->GetNrMipLevels(), pUncompressed->GetNrMipLevels());
+
+		for (int mipLevel{}; mipLevel < pCompressed->GetNrMipLevels(); ++mipLevel)
+		{
+			const int levelSize{ std::max(maps.width >> mipLevel, 1) };
+			for (int blockY{}; blockY < levelSize; blockY += 4)
+			{
+				for (int blockX{}; blockX < levelSize; blockX += 4)
+				{
+					//the range of each BC4 channel over the block
+					int minValues[4]{ 255, 255, 255, 255 };
+					int maxValues[4]{};
+					for (int y{ blockY }; y < std::min(blockY + 4, levelSize); ++y)
+					{
+						for (int x{ blockX }; x < std::min(blockX + 4, levelSize); ++x)
+						{
+							const MaterialTexel source{ SampleTexel(*pUncompressed, x, y, mipLevel, levelSize) };
+							for (int channel{}; channel < 4; ++channel)
+							{
+								minValues[channel] = std::min(minValues[channel], source.channels[3 + channel]);
+								maxValues[channel] = std::max(maxValues[channel], source.channels[3 + channel]);
+							}
+						}
+					}
+
+					for (int y{ blockY }; y < std::min(blockY + 4, levelSize); ++y)
+					{
+						for (int x{ blockX }; x < std::min(blockX + 4, levelSize); ++x)
+						{
+							const MaterialTexel source{ SampleTexel(*pUncompressed, x, y, mipLevel, levelSize) };
+							const MaterialTexel decoded{ SampleTexel(*pCompressed, x, y, mipLevel, levelSize) };
+							for (int channel{}; channel < 4; ++channel)
+							{
+								const int range{ maxValues[channel] - minValues[channel] };
+								EXPECT_LE(std::abs(decoded.channels[3 + channel] - source.channels[3 + channel]), range / 14 + 1)
+									<< "level " << mipLevel << ", texel " << x << ", " << y << ", channel " << channel;
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	TEST(BlockCompression, Bc1RoundTripErrorIsBoundedByThePalette)
+	{
+		//every block is a gradient between 2 random colors, a darker and a brighter one in every channel
+		//so the texels lie on the diagonal of the bounding box the endpoints are fit to:
+		//4 palette entries span the range in 3 steps, off by at most half a step plus the 565 quantization
+		MaterialMaps maps{ 64, 64 };
+		std::mt19937 random{ 5 };
+		std::uniform_int_distribution<uint32_t> byteDistribution{ 0, 255 };
+		std::uniform_real_distribution<float> weightDistribution{ 0.f, 1.f };
+		int ranges[16][16][3]{};
+		for (int blockY{}; blockY < 16; ++blockY)
+		{
+			for (int blockX{}; blockX < 16; ++blockX)
+			{
+				uint32_t darkColor[3]{};
+				uint32_t brightColor[3]{};
+				for (int channel{}; channel < 3; ++channel)
+				{
+					const uint32_t value0{ byteDistribution(random) };
+					const uint32_t value1{ byteDistribution(random) };
+					darkColor[channel] = std::min(value0, value1);
+					brightColor[channel] = std::max(value0, value1);
+					ranges[blockY][blockX][channel] = static_cast<int>(brightColor[channel] - darkColor[channel]);
+				}
+
+				for (int texelIdx{}; texelIdx < 16; ++texelIdx)
+				{
+					//the first 2 texels are the ends of the gradient
+					const float weight{ texelIdx < 2 ? static_cast<float>(texelIdx) : weightDistribution(random) };
+					uint32_t color{};
+					for (int channel{}; channel < 3; ++channel)
+					{
+						const float value{ static_cast<float>(darkColor[channel]) + weight * static_cast<float>(brightColor[channel] - darkColor[channel]) };
+						color |= static_cast<uint32_t>(std::lround(value)) << (channel * 8);
+					}
+					maps.diffuse[(blockY * 4 + texelIdx / 4) * maps.width + blockX * 4 + texelIdx % 4] = color;
+				}
+			}
+		}
+		const std::unique_ptr<Texture> pCompressed{ maps.Create(Texture::MaterialFormat::compressed) };
+
+		for (int y{}; y < maps.height; ++y)
+		{
+			for (int x{}; x < maps.width; ++x)
+			{
+				const uint32_t source{ maps.diffuse[y * maps.width + x] };
+				const MaterialTexel decoded{ SampleTexel(*pCompressed, x, y, 0, maps.width) };
+				for (int channel{}; channel < 3; ++channel)
+				{
+					const int sourceValue{ static_cast<int>((source >> (channel * 8)) & 0xFF) };
+					//green has 6 bits
+					const int quantizationError{ channel == 1 ? 3 : 5 };
+					EXPECT_LE(std::abs(decoded.channels[channel] - sourceValue), ranges[y / 4][x / 4][channel] / 6 + quantizationError + 1)
+						<< "texel " << x << ", " << y << ", channel " << channel;
+				}
+			}
+		}
+	}
+
+	TEST(Texture, SampleMaterialBatchMatchesSampleMaterialAtEverySimdLevel)
+	{
+		const SimdLevelScope simdLevelScope{};
+		const MaterialMaps maps{ CreateNoiseMaps(64, 32, 3) };
+
+		struct Material
+		{
+			Texture::MaterialFormat format;
+			Texture::TexelLayout layout;
+		};
+		const Material materials[]
+		{
+			{ Texture::MaterialFormat::uncompressed, Texture::TexelLayout::rowMajor },
+			{ Texture::MaterialFormat::uncompressed, Texture::TexelLayout::tiled },
+			{ Texture::MaterialFormat::compressed, Texture::TexelLayout::rowMajor }
+		};
+
+		std::mt19937 random{ 11 };
+		//a bit outside [0, 1] to hit the clamping, every mip level and beyond
+		std::uniform_real_distribution<float> uvDistribution{ -.1f, 1.1f };
+		std::uniform_real_distribution<float> uvLodDistribution{ -10.f, 2.f };
+
+		for (const auto& [format, layout] : materials)
+		{
+			const std::unique_ptr<Texture> pMaterial{ maps.Create(format, layout) };
+
+			for (SimdLevel simdLevel : { SimdLevel::scalar, SimdLevel::sse4, SimdLevel::avx2, SimdLevel::avx512 })
+			{
+				if (simdLevel > GetSupportedSimdLevel()) continue;
+				SetSimdLevel(simdLevel);
+
+				for (int batchIdx{}; batchIdx < 64; ++batchIdx)
+				{
+					alignas(32) float u[8]{};
+					alignas(32) float v[8]{};
+					alignas(32) float uvLods[8]{};
+					for (int lane{}; lane < 8; ++lane)
+					{
+						u[lane] = uvDistribution(random);
+						v[lane] = uvDistribution(random);
+						uvLods[lane] = uvLodDistribution(random);
+					}
+					const uint32_t laneMask{ batchIdx % 4 == 0 ? 0xFFu : static_cast<uint32_t>(random() & 0xFF) };
+
+					//one SampleMaterial per lane, with and without the decoded block cache
+					for (bool useDecodedBlockCache : { false, true })
+					{
+						pMaterial->SetDecodedBlockCache(useDecodedBlockCache);
+						Texture::MaterialBatch expected{};
+						for (int lane{}; lane < 8; ++lane)
+						{
+							const Texture::MaterialSample material{ pMaterial->SampleMaterial(Vector2{ u[lane], v[lane] }, uvLods[lane]) };
+							expected.diffuse[0][lane] = material.diffuse.r;
+							expected.diffuse[1][lane] = material.diffuse.g;
+							expected.diffuse[2][lane] = material.diffuse.b;
+							expected.normal[0][lane] = material.normal.x;
+							expected.normal[1][lane] = material.normal.y;
+							expected.normal[2][lane] = material.normal.z;
+							expected.specular[lane] = material.specular;
+							expected.glossiness[lane] = material.glossiness;
+						}
+
+						Texture::MaterialBatch batch{};
+						pMaterial->SampleMaterialBatch(u, v, uvLods, laneMask, batch);
+						SCOPED_TRACE(std::string{ GetSimdLevelName(simdLevel) } + (useDecodedBlockCache ? ", decoded block cache" : ""));
+						ExpectSameLanes(batch, expected, laneMask);
+					}
+				}
+			}
+		}
+	}
+}